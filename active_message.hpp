@@ -35,13 +35,15 @@ class active_message
   public:
     active_message() = default;
 
+    // a lone active_message argument selects the copy or move constructor instead of this one
     template<class Function, class... Args,
-             __REQUIRES(can_serialize_all<Function,Args...>::value),
-             __REQUIRES(can_deserialize_all<Function,Args...>::value),
-             __REQUIRES(is_invocable<Function,Args...>::value)
+             __REQUIRES(sizeof...(Args) > 0 || !std::is_same<typename std::decay<Function>::type, active_message>::value),
+             __REQUIRES(can_serialize_all<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value),
+             __REQUIRES(can_deserialize_all<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value),
+             __REQUIRES(is_invocable<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value)
             >
-    explicit active_message(Function func, Args... args)
-      : message_(func, args...)
+    explicit active_message(Function&& func, Args&&... args)
+      : message_(std::forward<Function>(func), std::forward<Args>(args)...)
     {}
 
     any activate() const
@@ -49,17 +51,7 @@ class active_message
       return message_();
     }
 
-    template<class OutputArchive>
-    friend void serialize(OutputArchive& ar, const active_message& self)
-    {
-      ar(self.message_);
-    }
-
-    template<class InputArchive>
-    friend void deserialize(InputArchive& ar, active_message& self)
-    {
-      ar(self.message_);
-    }
+    SERIALIZABLE_MEMBERS(message_);
 
   private:
     serializable_closure message_;
@@ -74,21 +66,22 @@ class two_sided_active_message : private active_message
     // two_sided_active_message's constructor initializes the base active_message class with this function
     // as the function to call. The user's functions and arguments passed to two_sided_active_message's constructor are this function's arguments.
     // the result of this function is an active_message containing the reply
+    // the tuples arrive as rvalues freshly deserialized, so they are taken by value and moved from
     template<class Function1, class Tuple1,
              class Function2, class Tuple2>
-    static active_message apply_and_return_active_message_reply(Function1 func,       const Tuple1& args1,
-                                                                Function2 reply_func, const Tuple2& args2)
+    static active_message apply_and_return_active_message_reply(Function1 func,       Tuple1 args1,
+                                                                Function2 reply_func, Tuple2 args2)
     {
       // XXX need to handle the case where user_result is void
 
       // apply the user's function to the first tuple
-      auto user_result = apply(func, args1);
+      auto user_result = apply(func, std::move(args1));
 
       // concatenate reply_func, user_result, and args2 into a single tuple
-      auto constructor_args = std::tuple_cat(std::make_tuple(reply_func, user_result), args2);
+      auto constructor_args = std::tuple_cat(std::make_tuple(reply_func, std::move(user_result)), std::move(args2));
 
       // make an active_message containing the reply
-      return make_from_tuple<active_message>(constructor_args);
+      return make_from_tuple<active_message>(std::move(constructor_args));
     }
 
 
@@ -136,3 +129,123 @@ class two_sided_active_message : private active_message
     }
 };
 
+
+
+// active_message_batch packs many active_messages into a single serializable object
+// each message is serialized into the batch as a length-prefixed frame, so a batch
+// travels as a single buffer and pays the per-message transport overhead only once
+class active_message_batch
+{
+  public:
+    active_message_batch() = default;
+
+    void push_back(const active_message& message)
+    {
+      messages_.push_back(message);
+    }
+
+    void push_back(active_message&& message)
+    {
+      messages_.push_back(std::move(message));
+    }
+
+    template<class Function, class... Args>
+    void emplace_back(Function&& func, Args&&... args)
+    {
+      messages_.emplace_back(std::forward<Function>(func), std::forward<Args>(args)...);
+    }
+
+    void reserve(size_t n)
+    {
+      messages_.reserve(n);
+    }
+
+    size_t size() const
+    {
+      return messages_.size();
+    }
+
+    bool empty() const
+    {
+      return messages_.empty();
+    }
+
+    // activates each message in order and returns their results in the same order
+    std::vector<any> activate() const
+    {
+      std::vector<any> results;
+      results.reserve(messages_.size());
+
+      for(const active_message& message : messages_)
+      {
+        results.push_back(message.activate());
+      }
+
+      return results;
+    }
+
+    SERIALIZABLE_MEMBERS(messages_);
+
+  private:
+    std::vector<active_message> messages_;
+};
+
+
+// two_sided_active_message_batch is the batched analogue of two_sided_active_message
+// activating the batch activates each message in order and collects each message's
+// reply into an active_message_batch, which may be returned to the sender as a single frame
+class two_sided_active_message_batch
+{
+  public:
+    two_sided_active_message_batch() = default;
+
+    void push_back(const two_sided_active_message& message)
+    {
+      messages_.push_back(message);
+    }
+
+    void push_back(two_sided_active_message&& message)
+    {
+      messages_.push_back(std::move(message));
+    }
+
+    template<class Function1, class Tuple1, class Function2, class... Args2>
+    void emplace_back(Function1 func, const Tuple1& args1, Function2 reply_func, const std::tuple<Args2...>& args2)
+    {
+      messages_.emplace_back(func, args1, reply_func, args2);
+    }
+
+    void reserve(size_t n)
+    {
+      messages_.reserve(n);
+    }
+
+    size_t size() const
+    {
+      return messages_.size();
+    }
+
+    bool empty() const
+    {
+      return messages_.empty();
+    }
+
+    // activates each message in order and returns a batch containing their replies in the same order
+    active_message_batch activate() const
+    {
+      active_message_batch replies;
+      replies.reserve(messages_.size());
+
+      for(const two_sided_active_message& message : messages_)
+      {
+        replies.push_back(message.activate());
+      }
+
+      return replies;
+    }
+
+    SERIALIZABLE_MEMBERS(messages_);
+
+  private:
+    std::vector<two_sided_active_message> messages_;
+};
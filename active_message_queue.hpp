@@ -0,0 +1,220 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <shmem.h>
+
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+#include "active_message.hpp"
+
+
+// active_message_queue is a ring buffer of serialized active_messages which lives in OpenSHMEM's symmetric heap
+// every processing element owns one instance of the queue, and any processing element may enqueue a message
+// into another processing element's instance with one-sided puts
+// the owner of the queue activates the messages it has received by calling progress()
+//
+// the protocol is as follows:
+//   1. the sender reserves a slot by atomically incrementing the receiver's tail counter
+//   2. the sender waits until the receiver has released that slot (the receiver's head counter is within capacity)
+//   3. the sender puts the message's length and bytes into the slot
+//   4. the sender fences and then atomically publishes the slot's sequence number, which signals the receiver
+class active_message_queue
+{
+  public:
+    // constructing an active_message_queue is a collective operation:
+    // every processing element must construct the queue with the same arguments and in the same order
+    // relative to other symmetric allocations
+    inline explicit active_message_queue(size_t capacity = 64, size_t slot_size = 4096)
+      : capacity_(validate_arguments(capacity, slot_size)),
+        slot_size_(slot_size),
+        head_(allocate<long>(1)),
+        tail_(allocate<long>(1)),
+        sequence_numbers_(allocate<long>(capacity)),
+        slots_(allocate<char>(capacity * slot_size))
+    {
+      // make sure every processing element's counters are initialized before anyone enqueues
+      shmem_barrier_all();
+    }
+
+    active_message_queue(const active_message_queue&) = delete;
+
+    // destroying an active_message_queue is a collective operation
+    inline ~active_message_queue()
+    {
+      shmem_free(slots_);
+      shmem_free(sequence_numbers_);
+      shmem_free(tail_);
+      shmem_free(head_);
+    }
+
+    inline size_t capacity() const
+    {
+      return capacity_;
+    }
+
+    // the size of the largest serialized message this queue can carry
+    inline size_t max_message_size() const
+    {
+      return slot_size_ - sizeof(std::uint64_t);
+    }
+
+    // enqueues message into processing_element's instance of this queue
+    // if that queue is full, this function blocks until its owner makes progress
+    inline void enqueue(int processing_element, const active_message& message)
+    {
+      // large buffers within message are referenced by serialized rather than copied into it,
+      // and are put into the receiver's slot directly
+      gather_ostream serialized;
+
+      {
+        output_archive ar(serialized);
+        ar(message);
+      }
+
+      if(serialized.size() > max_message_size())
+      {
+        throw std::length_error("active_message_queue::enqueue(): Serialized message exceeds the queue's slot size.");
+      }
+
+      // reserve a slot in the receiver's queue
+      long ticket = shmem_long_atomic_fetch_inc(tail_, processing_element);
+
+      // wait until the receiver has consumed the message which previously occupied the slot
+      while(ticket - shmem_long_atomic_fetch(head_, processing_element) >= static_cast<long>(capacity_))
+      {
+        // spin
+      }
+
+      char* slot = slot_at(ticket);
+
+      // transmit the length followed by the message
+      std::uint64_t length = serialized.size();
+      shmem_putmem(slot, &length, sizeof(length), processing_element);
+
+      char* destination = slot + sizeof(length);
+      for(const iovec& segment : serialized.segments())
+      {
+        shmem_putmem(destination, segment.iov_base, segment.iov_len, processing_element);
+        destination += segment.iov_len;
+      }
+
+      // ensure the message arrives before the signal which publishes it
+      shmem_fence();
+
+      // signal the receiver by publishing the slot's sequence number
+      shmem_long_atomic_set(&sequence_numbers_[ticket % capacity_], ticket + 1, processing_element);
+    }
+
+    template<class Function, class... Args>
+    void enqueue(int processing_element, Function func, Args... args)
+    {
+      enqueue(processing_element, active_message(func, args...));
+    }
+
+    // activates every message which has arrived in this processing element's queue, in arrival order
+    // returns the number of messages activated
+    inline size_t progress()
+    {
+      int self = shmem_my_pe();
+      size_t num_activated = 0;
+
+      long head = shmem_long_atomic_fetch(head_, self);
+
+      while(shmem_long_atomic_fetch(&sequence_numbers_[head % capacity_], self) == head + 1)
+      {
+        const char* slot = slot_at(head);
+
+        std::uint64_t length = 0;
+        std::memcpy(&length, slot, sizeof(length));
+
+        active_message message = from_string<active_message>(slot + sizeof(length), length);
+
+        // release the slot before activation so that the message may enqueue into this queue without deadlock
+        ++head;
+        shmem_long_atomic_set(head_, head, self);
+
+        message.activate();
+        ++num_activated;
+      }
+
+      return num_activated;
+    }
+
+  private:
+    // validates the constructor's arguments before any symmetric memory is allocated,
+    // so that every processing element throws before reaching a collective operation
+    static size_t validate_arguments(size_t capacity, size_t slot_size)
+    {
+      if(capacity == 0)
+      {
+        throw std::invalid_argument("active_message_queue ctor: capacity must be positive.");
+      }
+
+      if(slot_size <= sizeof(std::uint64_t))
+      {
+        throw std::invalid_argument("active_message_queue ctor: slot_size is too small.");
+      }
+
+      if(capacity > std::numeric_limits<size_t>::max() / slot_size)
+      {
+        throw std::length_error("active_message_queue ctor: capacity * slot_size is too large.");
+      }
+
+      return capacity;
+    }
+
+    template<class T>
+    static T* allocate(size_t n)
+    {
+      T* result = static_cast<T*>(shmem_calloc(n, sizeof(T)));
+      if(result == nullptr)
+      {
+        throw std::bad_alloc();
+      }
+
+      return result;
+    }
+
+    inline char* slot_at(long ticket) const
+    {
+      return slots_ + (ticket % capacity_) * slot_size_;
+    }
+
+    size_t capacity_;
+    size_t slot_size_;
+
+    // these point to symmetric objects
+    long* head_;
+    long* tail_;
+    long* sequence_numbers_;
+    char* slots_;
+};
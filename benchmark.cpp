@@ -0,0 +1,465 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// To compile:
+//
+//     $ oshc++ -std=c++11 -O3 benchmark.cpp -o benchmark
+//
+// To run every benchmark, or only those whose names contain a filter string:
+//
+//     $ ./benchmark
+//     $ ./benchmark serialization
+//
+// Each measurement is printed to stdout as a single line of JSON:
+//
+//     {"benchmark": "<name>", "parameter": <value>, "metric": "<metric>", "value": <value>, "unit": "<unit>"}
+//
+// The benchmarks which launch processing elements use oshrun, so a local, single-node OpenSHMEM
+// (e.g., OSHMPI or Sandia OpenSHMEM over shared memory) is sufficient.
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+
+#include "shmem_executor.hpp"
+
+
+// the size of the largest message used by the remote_ptr benchmarks
+constexpr size_t max_message_size = 1 << 16;
+
+
+class benchmark_reporter
+{
+  public:
+    explicit benchmark_reporter(const char* filter)
+      : filter_(filter)
+    {}
+
+    bool enabled(const char* benchmark) const
+    {
+      return std::strstr(benchmark, filter_) != nullptr;
+    }
+
+    void report(const char* benchmark, size_t parameter, const char* metric, double value, const char* unit) const
+    {
+      std::cout << "{\"benchmark\": \"" << benchmark << "\", "
+                << "\"parameter\": " << parameter << ", "
+                << "\"metric\": \"" << metric << "\", "
+                << "\"value\": " << value << ", "
+                << "\"unit\": \"" << unit << "\"}" << std::endl;
+    }
+
+  private:
+    const char* filter_;
+};
+
+
+template<class Function>
+double time_in_seconds(Function f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void noop(int, remote_reference<int>)
+{
+}
+
+void twoway_noop(int idx, remote_reference<int> result, remote_reference<int>)
+{
+  if(idx == 0)
+  {
+    result = 0;
+  }
+}
+
+int zero()
+{
+  return 0;
+}
+
+
+void benchmark_bulk_execute(const benchmark_reporter& reporter, size_t num_trials)
+{
+  shmem_executor exec;
+
+  for(size_t n : {1, 2, 4})
+  {
+    if(reporter.enabled("bulk_execute"))
+    {
+      double seconds = time_in_seconds([&]
+      {
+        for(size_t i = 0; i < num_trials; ++i)
+        {
+          exec.bulk_execute(noop, n, zero);
+
+          // bulk_execute is one-way, so wait for the spawned processes to complete
+          global_process_context.wait();
+        }
+      });
+
+      reporter.report("bulk_execute", n, "launch_to_completion_latency", seconds / num_trials, "s");
+    }
+
+    if(reporter.enabled("prepared_bulk_execute"))
+    {
+      shmem_executor::prepared_job job = exec.prepare_bulk_execute(noop, zero);
+
+      double seconds = time_in_seconds([&]
+      {
+        for(size_t i = 0; i < num_trials; ++i)
+        {
+          exec.bulk_execute(job, n);
+          global_process_context.wait();
+        }
+      });
+
+      exec.release(job);
+
+      reporter.report("prepared_bulk_execute", n, "launch_to_completion_latency", seconds / num_trials, "s");
+    }
+
+    if(reporter.enabled("twoway_bulk_execute"))
+    {
+      double seconds = time_in_seconds([&]
+      {
+        for(size_t i = 0; i < num_trials; ++i)
+        {
+          exec.twoway_bulk_execute(twoway_noop, n, zero, zero).get();
+        }
+      });
+
+      reporter.report("twoway_bulk_execute", n, "launch_to_completion_latency", seconds / num_trials, "s");
+    }
+  }
+}
+
+
+void benchmark_new_process_executor(const benchmark_reporter& reporter, size_t num_trials)
+{
+  if(!reporter.enabled("new_process_executor_twoway_execute")) return;
+
+  new_process_executor exec;
+
+  double seconds = time_in_seconds([&]
+  {
+    for(size_t i = 0; i < num_trials; ++i)
+    {
+      exec.twoway_execute(zero).get();
+    }
+  });
+
+  reporter.report("new_process_executor_twoway_execute", 1, "round_trip_latency", seconds / num_trials, "s");
+}
+
+
+void benchmark_spawn(const benchmark_reporter& reporter, size_t num_trials)
+{
+  // avoid touching the large resident sets below unless a spawn benchmark will run
+  if(!reporter.enabled("spawn_posix_spawn") && !reporter.enabled("spawn_vfork")) return;
+
+  spawn_attributes vfork_attributes;
+  vfork_attributes.backend = spawn_attributes::vfork_backend;
+
+  std::array<std::pair<const char*, spawn_attributes>, 2> backends = {{
+    {"spawn_posix_spawn", spawn_attributes()},
+    {"spawn_vfork", vfork_attributes}
+  }};
+
+  // the cost of fork-like spawning grows with the size of the parent's resident set,
+  // so spawn from parents of increasing size
+  std::vector<char> resident_set;
+
+  for(size_t resident_set_mib : {0, 256, 1024})
+  {
+    // touch every page so that it is resident
+    resident_set.assign(resident_set_mib << 20, 1);
+
+    for(const auto& backend : backends)
+    {
+      if(!reporter.enabled(backend.first)) continue;
+
+      new_process_executor exec(backend.second);
+
+      double seconds = 0;
+
+      for(size_t i = 0; i < num_trials; ++i)
+      {
+        // measure only the time until execute() returns, not the spawned process's lifetime
+        seconds += time_in_seconds([&]
+        {
+          exec.execute(zero);
+        });
+
+        global_process_context.wait();
+      }
+
+      reporter.report(backend.first, resident_set_mib, "spawn_latency", seconds / num_trials, "s");
+    }
+  }
+}
+
+
+template<class OutputArchive, class InputArchive, class T>
+void benchmark_archive(const benchmark_reporter& reporter, const char* name, const T& value, size_t num_values)
+{
+  if(!reporter.enabled(name)) return;
+
+  std::stringstream stream;
+
+  double serialize_seconds = time_in_seconds([&]
+  {
+    OutputArchive ar(stream);
+
+    for(size_t i = 0; i < num_values; ++i)
+    {
+      ar(value);
+    }
+  });
+
+  size_t num_bytes = stream.str().size();
+
+  double deserialize_seconds = time_in_seconds([&]
+  {
+    InputArchive ar(stream);
+
+    T result;
+    for(size_t i = 0; i < num_values; ++i)
+    {
+      ar(result);
+    }
+  });
+
+  reporter.report(name, num_values, "serialize_throughput", num_bytes / serialize_seconds, "B/s");
+  reporter.report(name, num_values, "deserialize_throughput", num_bytes / deserialize_seconds, "B/s");
+  reporter.report(name, num_values, "encoded_size", double(num_bytes) / num_values, "B");
+}
+
+
+void benchmark_archives(const benchmark_reporter& reporter)
+{
+  const size_t num_values = 1 << 16;
+
+  benchmark_archive<output_archive,input_archive>(reporter, "serialization_int", 123456789, num_values);
+  benchmark_archive<output_archive,input_archive>(reporter, "serialization_double", 3.14159, num_values);
+  benchmark_archive<output_archive,input_archive>(reporter, "serialization_string_1KiB", std::string(1024, 'x'), num_values / 16);
+  benchmark_archive<output_archive,input_archive>(reporter, "serialization_vector_int_1Ki", std::vector<int>(1024, 7), num_values / 256);
+
+  benchmark_archive<compact_output_archive,compact_input_archive>(reporter, "compact_serialization_int", 123456789, num_values);
+  benchmark_archive<compact_output_archive,compact_input_archive>(reporter, "compact_serialization_double", 3.14159, num_values);
+  benchmark_archive<compact_output_archive,compact_input_archive>(reporter, "compact_serialization_string_1KiB", std::string(1024, 'x'), num_values / 16);
+  benchmark_archive<compact_output_archive,compact_input_archive>(reporter, "compact_serialization_vector_int_1Ki", std::vector<int>(1024, 7), num_values / 256);
+}
+
+
+// remote_access_measurements is the result of the remote_ptr benchmark, which each processing element returns
+// remote_ptr stores require a trivially copyable result
+struct remote_access_measurements
+{
+  static constexpr size_t num_sizes = 14; // 8 B, 16 B, ..., 64 KiB
+
+  double load_latency[num_sizes];
+  double store_latency[num_sizes];
+
+  static size_t message_size(size_t i)
+  {
+    return size_t(8) << i;
+  }
+
+  template<class OutputArchive>
+  friend void serialize(OutputArchive& ar, const remote_access_measurements& self)
+  {
+    for(size_t i = 0; i < num_sizes; ++i)
+    {
+      ar(self.load_latency[i], self.store_latency[i]);
+    }
+  }
+
+  template<class InputArchive>
+  friend void deserialize(InputArchive& ar, remote_access_measurements& self)
+  {
+    for(size_t i = 0; i < num_sizes; ++i)
+    {
+      ar(self.load_latency[i], self.store_latency[i]);
+    }
+  }
+};
+
+constexpr size_t remote_access_measurements::num_sizes;
+
+
+template<size_t Size>
+struct message
+{
+  char bytes[Size];
+};
+
+
+template<size_t Size>
+void measure_remote_access(int target, size_t i, remote_access_measurements& result)
+{
+  // each processing element's copy of this buffer is symmetric
+  static message<Size> symmetric_buffer;
+
+  remote_ptr<message<Size>> ptr(&symmetric_buffer, target);
+
+  const size_t num_trials = 100;
+
+  message<Size> value{};
+
+  result.store_latency[i] = time_in_seconds([&]
+  {
+    for(size_t trial = 0; trial < num_trials; ++trial)
+    {
+      *ptr = value;
+    }
+
+    shmem_quiet();
+  }) / num_trials;
+
+  result.load_latency[i] = time_in_seconds([&]
+  {
+    for(size_t trial = 0; trial < num_trials; ++trial)
+    {
+      value = *ptr;
+    }
+  }) / num_trials;
+}
+
+
+template<size_t... Indices>
+void measure_remote_access_all_sizes(index_sequence<Indices...>, int target, remote_access_measurements& result)
+{
+  int unused[] = {0, (measure_remote_access<(size_t(8) << Indices)>(target, Indices, result), 0)...};
+  (void)unused;
+}
+
+
+void remote_access(int idx, remote_reference<remote_access_measurements> result, remote_reference<int>)
+{
+  // every processing element's symmetric buffers must exist before anyone accesses them
+  shmem_barrier_all();
+
+  if(idx == 0)
+  {
+    // processing element 0 measures accesses to its neighbor, or to itself if it is alone
+    int target = shmem_n_pes() > 1 ? 1 : 0;
+
+    remote_access_measurements measurements{};
+    measure_remote_access_all_sizes(make_index_sequence<remote_access_measurements::num_sizes>(), target, measurements);
+
+    result = measurements;
+  }
+}
+
+remote_access_measurements make_remote_access_measurements()
+{
+  return remote_access_measurements{};
+}
+
+
+void benchmark_remote_ptr(const benchmark_reporter& reporter)
+{
+  if(!reporter.enabled("remote_ptr")) return;
+
+  static_assert((size_t(8) << (remote_access_measurements::num_sizes - 1)) == max_message_size, "remote_access_measurements::num_sizes is inconsistent with max_message_size.");
+
+  shmem_executor exec;
+  remote_access_measurements measurements = exec.twoway_bulk_execute(remote_access, 2, make_remote_access_measurements, zero).get();
+
+  for(size_t i = 0; i < remote_access_measurements::num_sizes; ++i)
+  {
+    size_t size = remote_access_measurements::message_size(i);
+
+    reporter.report("remote_ptr_load", size, "latency", measurements.load_latency[i], "s");
+    reporter.report("remote_ptr_load", size, "bandwidth", size / measurements.load_latency[i], "B/s");
+    reporter.report("remote_ptr_store", size, "latency", measurements.store_latency[i], "s");
+    reporter.report("remote_ptr_store", size, "bandwidth", size / measurements.store_latency[i], "B/s");
+  }
+}
+
+
+void benchmark_interprocess_future(const benchmark_reporter& reporter, size_t num_trials)
+{
+  if(!reporter.enabled("interprocess_future")) return;
+
+  double seconds = 0;
+
+  for(size_t i = 0; i < num_trials; ++i)
+  {
+    int fds[2];
+    if(pipe(fds) == -1)
+    {
+      throw std::system_error(errno, std::system_category(), "benchmark_interprocess_future(): Error after pipe()");
+    }
+
+    interprocess_future<int> future(fds[0]);
+
+    seconds += time_in_seconds([&]
+    {
+      // fulfill the promise from another thread and wait for delivery
+      std::thread producer([&]
+      {
+        file_descriptor_ostream os(fds[1]);
+        interprocess_promise<int> promise(os);
+        promise.set_value(13);
+        ::close(fds[1]);
+      });
+
+      future.get();
+
+      producer.join();
+    });
+  }
+
+  reporter.report("interprocess_future", 1, "delivery_latency", seconds / num_trials, "s");
+}
+
+
+int main(int argc, char** argv)
+{
+  benchmark_reporter reporter(argc > 1 ? argv[1] : "");
+
+  const size_t num_launches = 10;
+
+  benchmark_archives(reporter);
+  benchmark_interprocess_future(reporter, 1000);
+  benchmark_new_process_executor(reporter, num_launches);
+  benchmark_spawn(reporter, num_launches);
+  benchmark_bulk_execute(reporter, num_launches);
+  benchmark_remote_ptr(reporter);
+
+  return 0;
+}
+
@@ -0,0 +1,251 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// compress_block & decompress_block implement a small LZ77 compressor which produces the LZ4 block format
+// the compressor favors speed over ratio: it finds matches through a single-entry hash table of recently seen
+// four-byte sequences and never searches further back
+// the decompressor validates every length and offset, and throws std::runtime_error on malformed input
+
+
+inline std::uint32_t load_uint32(const char* ptr)
+{
+  std::uint32_t result;
+  std::memcpy(&result, ptr, sizeof(result));
+  return result;
+}
+
+
+inline std::uint32_t hash_sequence(std::uint32_t sequence)
+{
+  // Knuth's multiplicative hash, keeping the upper 12 bits
+  return (sequence * 2654435761u) >> 20;
+}
+
+
+inline void write_length_extension(std::string& result, std::size_t length)
+{
+  while(length >= 255)
+  {
+    result.push_back(static_cast<char>(255));
+    length -= 255;
+  }
+
+  result.push_back(static_cast<char>(length));
+}
+
+
+// a match_length of zero indicates the final sequence, which holds only literals
+inline void write_sequence(std::string& result, const char* literals, std::size_t num_literals, std::size_t offset, std::size_t match_length)
+{
+  const std::size_t min_match_length = 4;
+
+  std::size_t match_code = match_length == 0 ? 0 : match_length - min_match_length;
+
+  // the token holds the number of literals in its upper nibble and the match length in its lower nibble
+  unsigned char token = static_cast<unsigned char>((std::min<std::size_t>(num_literals, 15) << 4) | std::min<std::size_t>(match_code, 15));
+  result.push_back(static_cast<char>(token));
+
+  if(num_literals >= 15)
+  {
+    write_length_extension(result, num_literals - 15);
+  }
+
+  result.append(literals, num_literals);
+
+  if(match_length > 0)
+  {
+    // the offset is little endian
+    result.push_back(static_cast<char>(offset & 0xff));
+    result.push_back(static_cast<char>(offset >> 8));
+
+    if(match_code >= 15)
+    {
+      write_length_extension(result, match_code - 15);
+    }
+  }
+}
+
+
+inline std::string compress_block(const char* data, std::size_t size)
+{
+  const std::size_t min_match_length = 4;
+  const std::size_t max_offset = 65535;
+
+  // as in LZ4, the last five bytes are always literals and no match begins within the last twelve bytes
+  const std::size_t num_last_literals = 5;
+  const std::size_t match_start_limit = 12;
+
+  std::string result;
+  result.reserve(size / 2 + 16);
+
+  std::size_t anchor = 0;
+
+  if(size > match_start_limit)
+  {
+    const std::size_t no_position = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> table(1 << 12, no_position);
+
+    std::size_t match_end_limit = size - num_last_literals;
+
+    std::size_t i = 0;
+    while(i + match_start_limit < size)
+    {
+      std::uint32_t sequence = load_uint32(data + i);
+      std::size_t& entry = table[hash_sequence(sequence)];
+      std::size_t candidate = entry;
+      entry = i;
+
+      if(candidate != no_position && i - candidate <= max_offset && load_uint32(data + candidate) == sequence)
+      {
+        // extend the match as far as possible
+        std::size_t match_end = i + min_match_length;
+        while(match_end < match_end_limit && data[match_end] == data[candidate + (match_end - i)])
+        {
+          ++match_end;
+        }
+
+        write_sequence(result, data + anchor, i - anchor, i - candidate, match_end - i);
+
+        i = match_end;
+        anchor = i;
+      }
+      else
+      {
+        ++i;
+      }
+    }
+  }
+
+  // the remaining bytes are literals
+  write_sequence(result, data + anchor, size - anchor, 0, 0);
+
+  return result;
+}
+
+
+inline std::size_t read_length_extension(const unsigned char*& ptr, const unsigned char* end)
+{
+  std::size_t result = 0;
+
+  unsigned char byte = 255;
+  while(byte == 255)
+  {
+    if(ptr == end)
+    {
+      throw std::runtime_error("decompress_block(): Truncated length.");
+    }
+
+    byte = *ptr++;
+    result += byte;
+  }
+
+  return result;
+}
+
+
+// decompresses a block which must expand to exactly result_size bytes
+inline void decompress_block(const char* data, std::size_t size, char* result, std::size_t result_size)
+{
+  const std::size_t min_match_length = 4;
+
+  const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* end = ptr + size;
+
+  std::size_t position = 0;
+
+  while(ptr < end)
+  {
+    unsigned char token = *ptr++;
+
+    // copy literals
+    std::size_t num_literals = token >> 4;
+    if(num_literals == 15)
+    {
+      num_literals += read_length_extension(ptr, end);
+    }
+
+    if(num_literals > static_cast<std::size_t>(end - ptr) || num_literals > result_size - position)
+    {
+      throw std::runtime_error("decompress_block(): Literals overrun the block.");
+    }
+
+    std::memcpy(result + position, ptr, num_literals);
+    ptr += num_literals;
+    position += num_literals;
+
+    // the final sequence holds no match
+    if(ptr == end)
+    {
+      break;
+    }
+
+    // copy the match
+    if(end - ptr < 2)
+    {
+      throw std::runtime_error("decompress_block(): Truncated offset.");
+    }
+
+    std::size_t offset = ptr[0] | (static_cast<std::size_t>(ptr[1]) << 8);
+    ptr += 2;
+
+    std::size_t match_length = token & 15;
+    if(match_length == 15)
+    {
+      match_length += read_length_extension(ptr, end);
+    }
+    match_length += min_match_length;
+
+    if(offset == 0 || offset > position || match_length > result_size - position)
+    {
+      throw std::runtime_error("decompress_block(): Invalid match.");
+    }
+
+    // matches may overlap the bytes they produce, so copy forward one byte at a time
+    const char* source = result + position - offset;
+    for(std::size_t i = 0; i < match_length; ++i)
+    {
+      result[position + i] = source[i];
+    }
+
+    position += match_length;
+  }
+
+  if(position != result_size)
+  {
+    throw std::runtime_error("decompress_block(): Block does not match its expected size.");
+  }
+}
+
@@ -0,0 +1,297 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "compression.hpp"
+#include "gather_stream.hpp"
+#include "serialization.hpp"
+
+
+// a frame is a header followed by a payload of bytes
+// the header is a fixed size and identifies the frame format, its version, and the type serialized into the payload,
+// so a receiver built from different sources detects a mismatch instead of misparsing the payload,
+// and it holds the sizes of the payload, so a receiver may skip a frame without parsing it
+enum frame_flags : std::uint8_t
+{
+  frame_compressed = 1,
+
+  // the payload follows in a shared memory segment whose file descriptor accompanies the header (see shared_memory.hpp)
+  frame_shared_memory = 2
+};
+
+
+// "SXFR" in little endian
+constexpr std::uint32_t frame_magic = 0x52465853;
+
+// the version changes whenever the frame or archive format does
+constexpr std::uint8_t frame_version = 1;
+
+
+// hashes [first, last) with FNV-1a
+// longer ranges are hashed in halves so that the depth of constexpr recursion is logarithmic in the length
+constexpr std::uint64_t fnv1a_hash(const char* first, const char* last, std::uint64_t hash = 14695981039346656037ull)
+{
+  return first == last ? hash :
+         last - first <= 16 ? fnv1a_hash(first + 1, last, (hash ^ static_cast<unsigned char>(*first)) * 1099511628211ull) :
+         fnv1a_hash(first + (last - first) / 2, last, fnv1a_hash(first, first + (last - first) / 2, hash));
+}
+
+
+// returns a hash of the names of the types in Ts... computed at compile time
+// the names come from the compiler's spelling of this function's signature, so hashes agree across builds with the same compiler
+template<class... Ts>
+constexpr std::uint64_t frame_type_hash()
+{
+  return fnv1a_hash(__PRETTY_FUNCTION__, __PRETTY_FUNCTION__ + sizeof(__PRETTY_FUNCTION__) - 1);
+}
+
+
+// the header's members fill it without padding, so compact archives encode it as its bytes with a single copy
+struct frame_header
+{
+  std::uint32_t magic;
+  std::uint8_t version;
+  std::uint8_t flags;
+  std::uint16_t reserved;
+
+  // the hash of the payload's type, or zero when the frame does not identify its payload's type
+  std::uint64_t type_hash;
+
+  std::uint64_t payload_size;
+  std::uint64_t transmitted_size;
+
+  frame_header() = default;
+
+  frame_header(std::uint8_t flags_, std::uint64_t payload_size_, std::uint64_t transmitted_size_, std::uint64_t type_hash_ = 0)
+    : magic(frame_magic),
+      version(frame_version),
+      flags(flags_),
+      reserved(0),
+      type_hash(type_hash_),
+      payload_size(payload_size_),
+      transmitted_size(transmitted_size_)
+  {}
+
+  SERIALIZABLE_MEMBERS(magic, version, flags, reserved, type_hash, payload_size, transmitted_size);
+};
+
+
+// payloads at least this large are compressed when compression makes them smaller
+// the threshold may be set through the environment variable SHMEM_EXECUTOR_COMPRESSION_THRESHOLD
+inline std::size_t default_frame_compression_threshold()
+{
+  static const std::size_t result = []
+  {
+    const char* variable = std::getenv("SHMEM_EXECUTOR_COMPRESSION_THRESHOLD");
+    return variable ? static_cast<std::size_t>(std::strtoull(variable, nullptr, 10)) : std::size_t(64 * 1024);
+  }();
+
+  return result;
+}
+
+
+inline void write_frame_header(std::ostream& os, const frame_header& header)
+{
+  compact_output_archive ar(os);
+  ar(header);
+}
+
+
+// writes a frame holding payload into os
+// when os is a gather_ostream, an uncompressed payload is referenced rather than copied, so payload must outlive os
+inline void write_frame(std::ostream& os,
+                        const std::string& payload,
+                        std::size_t compression_threshold = default_frame_compression_threshold(),
+                        std::uint64_t type_hash = 0)
+{
+  frame_header header(0, payload.size(), payload.size(), type_hash);
+
+  if(payload.size() >= compression_threshold)
+  {
+    std::string compressed = compress_block(payload.data(), payload.size());
+
+    if(compressed.size() < payload.size())
+    {
+      header.flags |= frame_compressed;
+      header.transmitted_size = compressed.size();
+
+      write_frame_header(os, header);
+      os.write(compressed.data(), compressed.size());
+      os.flush();
+      return;
+    }
+  }
+
+  write_frame_header(os, header);
+
+  write_contiguous(os, payload.data(), payload.size());
+  os.flush();
+}
+
+
+// writes a frame holding the contents of payload into os
+// when os is a gather_ostream, the segments of an uncompressed payload are referenced rather than copied
+inline void write_frame(std::ostream& os,
+                        const gather_ostream& payload,
+                        std::size_t compression_threshold = default_frame_compression_threshold(),
+                        std::uint64_t type_hash = 0)
+{
+  if(payload.size() >= compression_threshold)
+  {
+    // compression requires the payload in one piece
+    std::string flattened = payload.flatten();
+    std::string compressed = compress_block(flattened.data(), flattened.size());
+
+    if(compressed.size() < flattened.size())
+    {
+      write_frame_header(os, frame_header(frame_compressed, flattened.size(), compressed.size(), type_hash));
+      os.write(compressed.data(), compressed.size());
+      os.flush();
+      return;
+    }
+  }
+
+  write_frame_header(os, frame_header(0, payload.size(), payload.size(), type_hash));
+
+  for(const iovec& segment : payload.segments())
+  {
+    write_contiguous(os, reinterpret_cast<const char*>(segment.iov_base), segment.iov_len);
+  }
+
+  os.flush();
+}
+
+
+// writes a frame holding the contents of payload to a file descriptor
+// the header and the payload's segments are written together with writev()
+inline void write_frame(int fd,
+                        const gather_ostream& payload,
+                        std::size_t compression_threshold = default_frame_compression_threshold(),
+                        std::uint64_t type_hash = 0)
+{
+  gather_ostream frame;
+  write_frame(frame, payload, compression_threshold, type_hash);
+
+  write_segments(fd, frame.segments());
+}
+
+
+// returns false if the stream ended or failed before the whole header was received
+// throws if the header is not a frame header of this version,
+// or if both expected_type_hash and the header's type hash are nonzero but differ
+inline bool read_frame_header(std::istream& is, frame_header& header, std::uint64_t expected_type_hash = 0)
+{
+  compact_input_archive ar(is);
+  ar(header);
+
+  if(!is)
+  {
+    return false;
+  }
+
+  if(header.magic != frame_magic)
+  {
+    throw std::runtime_error("read_frame_header(): Stream does not hold a frame.");
+  }
+
+  if(header.version != frame_version)
+  {
+    throw std::runtime_error("read_frame_header(): Frame version " + std::to_string(header.version) +
+                             " does not match this build's version " + std::to_string(frame_version) + ".");
+  }
+
+  if(expected_type_hash != 0 && header.type_hash != 0 && header.type_hash != expected_type_hash)
+  {
+    throw std::runtime_error("read_frame_header(): Frame holds a different type than expected.");
+  }
+
+  return true;
+}
+
+
+// skips the payload which follows a header received through the stream without reading it into memory
+// returns false if the stream ended or failed before the whole payload was skipped
+inline bool skip_frame_payload(std::istream& is, const frame_header& header)
+{
+  if(header.flags & frame_shared_memory)
+  {
+    // the payload does not travel through the stream
+    return true;
+  }
+
+  is.ignore(header.transmitted_size);
+
+  return static_cast<bool>(is);
+}
+
+
+// reads the payload which follows a header received through the stream
+// returns false if the stream ended or failed before the whole payload was received
+inline bool read_frame_payload(std::istream& is, const frame_header& header, std::string& payload)
+{
+  if(header.flags & frame_shared_memory)
+  {
+    // the payload does not travel through the stream
+    return false;
+  }
+
+  if(header.flags & frame_compressed)
+  {
+    std::string compressed(header.transmitted_size, '\0');
+    is.read(&compressed[0], header.transmitted_size);
+
+    if(!is)
+    {
+      return false;
+    }
+
+    payload.resize(header.payload_size);
+    decompress_block(compressed.data(), compressed.size(), &payload[0], payload.size());
+  }
+  else
+  {
+    payload.resize(header.transmitted_size);
+    is.read(&payload[0], header.transmitted_size);
+  }
+
+  return static_cast<bool>(is);
+}
+
+
+// returns false if the stream ended or failed before the whole frame was received
+inline bool read_frame(std::istream& is, std::string& payload, std::uint64_t expected_type_hash = 0)
+{
+  frame_header header;
+  return read_frame_header(is, header, expected_type_hash) && read_frame_payload(is, header, payload);
+}
+
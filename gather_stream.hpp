@@ -0,0 +1,230 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+
+// string_ostream is an output stream which appends to a string it owns
+// unlike std::stringstream, the string may be inspected or released without copying it
+class string_ostream : public std::ostream
+{
+  public:
+    string_ostream()
+      : std::ostream(nullptr)
+    {
+      // pass buffer_ to std::ostream *after* buffer_ has been constructed
+      rdbuf(&buffer_);
+    }
+
+    // takes ownership of string and appends to it
+    explicit string_ostream(std::string&& string)
+      : string_ostream()
+    {
+      buffer_.string = std::move(string);
+    }
+
+    string_ostream(const string_ostream&) = delete;
+
+    virtual ~string_ostream() {}
+
+    const std::string& str() const
+    {
+      return buffer_.string;
+    }
+
+    // returns the stream's string and leaves the stream empty
+    std::string release()
+    {
+      std::string result = std::move(buffer_.string);
+      buffer_.string.clear();
+      return result;
+    }
+
+  private:
+    struct string_buffer : public std::streambuf
+    {
+      std::string string;
+
+      int_type overflow(int_type c) override
+      {
+        if(c != traits_type::eof())
+        {
+          string.push_back(traits_type::to_char_type(c));
+        }
+
+        return c;
+      }
+
+      std::streamsize xsputn(const char* s, std::streamsize num) override
+      {
+        string.append(s, num);
+        return num;
+      }
+    };
+
+    string_buffer buffer_;
+};
+
+
+// gather_ostream is a string_ostream which may also refer to large buffers in place, without copying them
+// its contents are a list of segments: runs of bytes written into its string interleaved with the referenced buffers,
+// which a transport sends directly with writev() or copies once into their destination
+// the referenced buffers must outlive the gather_ostream's use
+class gather_ostream : public string_ostream
+{
+  public:
+    // buffers smaller than this are cheaper to copy than to refer to
+    constexpr static std::size_t min_reference_size = 4096;
+
+    // appends a reference to [data, data + size) to the stream's contents
+    void reference(const char* data, std::size_t size)
+    {
+      references_.push_back(buffer_reference{str().size(), data, size});
+      referenced_size_ += size;
+    }
+
+    // the total number of bytes in the stream, written or referenced
+    std::size_t size() const
+    {
+      return str().size() + referenced_size_;
+    }
+
+    std::vector<iovec> segments() const
+    {
+      std::vector<iovec> result;
+      result.reserve(2 * references_.size() + 1);
+
+      std::size_t offset = 0;
+      for(const buffer_reference& reference : references_)
+      {
+        if(reference.offset > offset)
+        {
+          result.push_back(iovec{const_cast<char*>(str().data()) + offset, reference.offset - offset});
+          offset = reference.offset;
+        }
+
+        result.push_back(iovec{const_cast<char*>(reference.data), reference.size});
+      }
+
+      if(str().size() > offset)
+      {
+        result.push_back(iovec{const_cast<char*>(str().data()) + offset, str().size() - offset});
+      }
+
+      return result;
+    }
+
+    // copies the stream's contents into a single string
+    std::string flatten() const
+    {
+      std::string result;
+      result.reserve(size());
+
+      for(const iovec& segment : segments())
+      {
+        result.append(reinterpret_cast<const char*>(segment.iov_base), segment.iov_len);
+      }
+
+      return result;
+    }
+
+  private:
+    struct buffer_reference
+    {
+      // the position in the stream's string at which the buffer belongs
+      std::size_t offset;
+      const char* data;
+      std::size_t size;
+    };
+
+    std::vector<buffer_reference> references_;
+    std::size_t referenced_size_ = 0;
+};
+
+
+// writes [data, data + size) into os
+// data must belong to the value being serialized: when os is a gather_ostream, large buffers are referenced rather than copied
+inline void write_contiguous(std::ostream& os, const char* data, std::size_t size)
+{
+  if(size >= gather_ostream::min_reference_size)
+  {
+    gather_ostream* gather = dynamic_cast<gather_ostream*>(&os);
+    if(gather)
+    {
+      gather->reference(data, size);
+      return;
+    }
+  }
+
+  os.write(data, size);
+}
+
+
+// writes each segment in order to the file descriptor with as few system calls as possible
+inline void write_segments(int fd, std::vector<iovec> segments)
+{
+  auto current = segments.begin();
+
+  while(current != segments.end())
+  {
+    int num_segments = static_cast<int>(std::min<std::ptrdiff_t>(segments.end() - current, IOV_MAX));
+
+    ssize_t num_written = ::writev(fd, &*current, num_segments);
+    if(num_written == -1)
+    {
+      if(errno == EINTR) continue;
+
+      throw std::system_error(errno, std::system_category(), "write_segments(): Error after writev()");
+    }
+
+    // skip the segments which were written completely, and advance into a segment which was written partially
+    std::size_t num_remaining = num_written;
+    while(current != segments.end() && num_remaining >= current->iov_len)
+    {
+      num_remaining -= current->iov_len;
+      ++current;
+    }
+
+    if(num_remaining > 0)
+    {
+      current->iov_base = reinterpret_cast<char*>(current->iov_base) + num_remaining;
+      current->iov_len -= num_remaining;
+    }
+  }
+}
@@ -0,0 +1,378 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "frame.hpp"
+#include "interprocess_future.hpp"
+#include "serialization.hpp"
+#include "socket.hpp"
+#include "string_view_stream.hpp"
+
+
+// interprocess_channel_writer is the sending end of an interprocess_channel
+// values pushed into the writer are serialized into batches, and each batch is sent as a single frame
+// containing the number of values in the batch followed by a frame (see frame.hpp) of serialized values
+// a frame containing only a count of zero marks the end of the stream
+template<class T>
+class interprocess_channel_writer
+{
+  public:
+    explicit interprocess_channel_writer(int file_descriptor, size_t batch_size = 64)
+      : file_descriptor_(file_descriptor),
+        batch_size_(batch_size),
+        batch_count_(0)
+    {}
+
+    interprocess_channel_writer(const interprocess_channel_writer&) = delete;
+
+    // a writer destroyed without being closed sends any pending values but no end-of-stream frame,
+    // which the receiving interprocess_channel reports as an interprocess_exception
+    // the writer may be destroyed while an exception unwinds, so errors while sending are swallowed:
+    // the receiver observes them as a truncated stream
+    ~interprocess_channel_writer()
+    {
+      if(file_descriptor_ != -1)
+      {
+        try
+        {
+          flush();
+        }
+        catch(...)
+        {
+        }
+
+        ::close(file_descriptor_);
+      }
+    }
+
+    void push(const T& value)
+    {
+      {
+        compact_output_archive ar(batch_);
+        ar(value);
+      }
+
+      if(++batch_count_ == batch_size_)
+      {
+        flush();
+      }
+    }
+
+    // sends any values which have been pushed but not yet sent
+    void flush()
+    {
+      if(batch_count_ > 0)
+      {
+        write_frame(batch_count_, batch_.str());
+
+        batch_.release();
+        batch_count_ = 0;
+      }
+    }
+
+    // sends any pending values followed by the end-of-stream frame and closes the file descriptor
+    void close()
+    {
+      flush();
+      write_end_of_stream_frame();
+
+      ::close(file_descriptor_);
+      file_descriptor_ = -1;
+    }
+
+  private:
+    // the count and frame header are sent together with the values in a single writev(), without copying the values
+    void write_frame(size_t count, const std::string& values)
+    {
+      gather_ostream frame;
+
+      {
+        compact_output_archive ar(frame);
+        ar(count);
+      }
+
+      ::write_frame(frame, values, default_frame_compression_threshold(), frame_type_hash<T>());
+
+      write_segments(file_descriptor_, frame.segments());
+    }
+
+    void write_end_of_stream_frame()
+    {
+      string_ostream frame;
+
+      {
+        compact_output_archive ar(frame);
+        ar(size_t(0));
+      }
+
+      write_segments(file_descriptor_, {iovec{const_cast<char*>(frame.str().data()), frame.str().size()}});
+    }
+
+    int file_descriptor_;
+    size_t batch_size_;
+    size_t batch_count_;
+    string_ostream batch_;
+};
+
+
+// interprocess_channel is the receiving end of a stream of values sent by one or more interprocess_channel_writers
+// values are received in the order each writer sent them; values from different writers are interleaved
+// in the order their frames arrive
+template<class T>
+class interprocess_channel
+{
+  public:
+    // receives from writers connected to the given file descriptors
+    explicit interprocess_channel(const std::vector<int>& file_descriptors)
+      : num_writers_to_accept_(0)
+    {
+      for(int fd : file_descriptors)
+      {
+        streams_.emplace_back(new file_descriptor_istream(fd));
+      }
+    }
+
+    // receives from num_writers writers which will connect to listener
+    interprocess_channel(acceptor&& listener, size_t num_writers)
+      : listener_(new acceptor(std::move(listener))),
+        num_writers_to_accept_(num_writers)
+    {}
+
+    interprocess_channel(interprocess_channel&&) = default;
+
+    ~interprocess_channel()
+    {
+      for(auto& stream : streams_)
+      {
+        ::close(stream->file_descriptor());
+      }
+    }
+
+    // receives the next value and returns true, or returns false if every writer has closed the stream
+    // blocks until a value is available or the stream ends
+    // throws interprocess_exception if a writer terminated without closing its end of the stream
+    bool pop(T& value)
+    {
+      while(values_.empty())
+      {
+        if(streams_.empty() && num_writers_to_accept_ == 0)
+        {
+          return false;
+        }
+
+        receive();
+      }
+
+      value = std::move(values_.front());
+      values_.pop_front();
+
+      return true;
+    }
+
+    class iterator
+    {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        iterator() : channel_(nullptr) {}
+
+        explicit iterator(interprocess_channel* channel)
+          : channel_(channel)
+        {
+          ++*this;
+        }
+
+        reference operator*() const
+        {
+          return value_;
+        }
+
+        pointer operator->() const
+        {
+          return &value_;
+        }
+
+        iterator& operator++()
+        {
+          if(!channel_->pop(value_))
+          {
+            channel_ = nullptr;
+          }
+
+          return *this;
+        }
+
+        bool operator==(const iterator& other) const
+        {
+          return channel_ == other.channel_;
+        }
+
+        bool operator!=(const iterator& other) const
+        {
+          return !(*this == other);
+        }
+
+      private:
+        interprocess_channel* channel_;
+        T value_;
+    };
+
+    iterator begin()
+    {
+      return iterator(this);
+    }
+
+    iterator end()
+    {
+      return iterator();
+    }
+
+  private:
+    // waits until a writer connects or a frame arrives and handles it
+    void receive()
+    {
+      // a stream which has already buffered some input is ready without polling
+      for(size_t i = 0; i < streams_.size(); ++i)
+      {
+        if(streams_[i]->rdbuf()->in_avail() > 0)
+        {
+          receive_frame(i);
+          return;
+        }
+      }
+
+      std::vector<pollfd> fds;
+      for(auto& stream : streams_)
+      {
+        fds.push_back(pollfd{stream->file_descriptor(), POLLIN, 0});
+      }
+
+      if(num_writers_to_accept_ > 0)
+      {
+        fds.push_back(pollfd{listener_->get(), POLLIN, 0});
+      }
+
+      if(::poll(fds.data(), fds.size(), -1) == -1)
+      {
+        if(errno == EINTR) return;
+
+        throw std::system_error(errno, std::system_category(), "interprocess_channel::receive(): Error after poll()");
+      }
+
+      if(num_writers_to_accept_ > 0 && fds.back().revents)
+      {
+        streams_.emplace_back(new file_descriptor_istream(listener_->accept()));
+        --num_writers_to_accept_;
+
+        if(num_writers_to_accept_ == 0)
+        {
+          // release the port as soon as every writer has connected
+          listener_.reset();
+        }
+        return;
+      }
+
+      for(size_t i = 0; i < streams_.size(); ++i)
+      {
+        if(fds[i].revents)
+        {
+          receive_frame(i);
+          return;
+        }
+      }
+    }
+
+    void receive_frame(size_t i)
+    {
+      compact_input_archive frame(*streams_[i]);
+
+      size_t count = 0;
+      frame(count);
+
+      if(!streams_[i]->fail() && count == 0)
+      {
+        // the writer closed its end of the stream
+        close_stream(i);
+        return;
+      }
+
+      std::string values;
+      if(!read_frame(*streams_[i], values, frame_type_hash<T>()))
+      {
+        close_stream(i);
+        throw interprocess_exception("interprocess_channel: A writer terminated before closing its end of the channel.");
+      }
+
+      string_view_stream is(values.data(), values.size());
+      compact_input_archive ar(is);
+
+      // deliver none of a frame's values unless all of them deserialize
+      std::vector<T> received;
+
+      for(size_t j = 0; j < count && is; ++j)
+      {
+        T value;
+        ar(value);
+        received.push_back(std::move(value));
+      }
+
+      if(!is)
+      {
+        throw interprocess_exception("interprocess_channel: A frame's values could not be deserialized.");
+      }
+
+      std::move(received.begin(), received.end(), std::back_inserter(values_));
+    }
+
+    void close_stream(size_t i)
+    {
+      ::close(streams_[i]->file_descriptor());
+      streams_.erase(streams_.begin() + i);
+    }
+
+    std::unique_ptr<acceptor> listener_;
+    size_t num_writers_to_accept_;
+    std::vector<std::unique_ptr<file_descriptor_istream>> streams_;
+    std::deque<T> values_;
+};
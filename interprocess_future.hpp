@@ -38,14 +38,22 @@
 #include <memory>
 #include <iostream>
 #include <future>
-#include <array>
+#include <sstream>
+#include <vector>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "optional.hpp"
 #include "variant.hpp"
 #include "serialization.hpp"
+#include "frame.hpp"
+#include "shared_memory.hpp"
+#include "socket.hpp"
+#include "string_view_stream.hpp"
+#include "trace.hpp"
 
 
 class file_descriptor_ostream : public std::ostream
@@ -57,6 +65,11 @@ class file_descriptor_ostream : public std::ostream
       rdbuf(&buffer_);
     }
 
+    inline int file_descriptor() const
+    {
+      return buffer_.file_descriptor();
+    }
+
   private:
     class file_descriptor_buffer : public std::streambuf
     {
@@ -67,6 +80,11 @@ class file_descriptor_ostream : public std::ostream
           : fd_(fd)
         {}
 
+        int file_descriptor() const
+        {
+          return fd_;
+        }
+
         inline virtual int_type overflow(int_type c)
         {
           if(c != traits_type::eof())
@@ -118,6 +136,21 @@ class file_descriptor_istream : public std::istream
       return buffer_.file_descriptor();
     }
 
+    // attaches a file descriptor to a stream created without one
+    inline void attach(int fd)
+    {
+      buffer_.attach(fd);
+      clear();
+    }
+
+    // returns the oldest file descriptor which arrived through the stream's socket and has not yet been taken,
+    // or -1 if there is none
+    // the caller becomes responsible for closing the returned file descriptor
+    inline int take_received_file_descriptor()
+    {
+      return buffer_.take_received_file_descriptor();
+    }
+
   private:
     class file_descriptor_buffer : public std::streambuf
     {
@@ -125,7 +158,7 @@ class file_descriptor_istream : public std::istream
         using traits_type = std::streambuf::traits_type;
 
         inline file_descriptor_buffer(int fd)
-          : fd_(fd)
+          : fd_(fd), buffer_(putback_size_ + min_buffer_size_)
         {
           setg(buffer_.data() + putback_size_,  // beginning of putback area
                buffer_.data() + putback_size_,  // read position
@@ -133,13 +166,22 @@ class file_descriptor_istream : public std::istream
         }
 
         file_descriptor_buffer(file_descriptor_buffer&& other)
-          : fd_(-1), buffer_(std::move(other.buffer_))
+          : fd_(-1),
+            is_socket_(other.is_socket_),
+            grow_(other.grow_),
+            file_descriptors_discarded_(other.file_descriptors_discarded_),
+            received_file_descriptors_(std::move(other.received_file_descriptors_))
         {
           std::swap(fd_, other.fd_);
+          other.received_file_descriptors_.clear();
+
+          // find the other buffer's positions before taking its storage
+          std::ptrdiff_t eback_idx = other.eback() - other.buffer_.data();
+          std::ptrdiff_t gptr_idx  = other.gptr() - other.buffer_.data();
+          std::ptrdiff_t egptr_idx = other.egptr() - other.buffer_.data();
 
-          int eback_idx = other.eback() - other.buffer_.data();
-          int gptr_idx  = other.gptr() - other.buffer_.data();
-          int egptr_idx = other.egptr() - other.buffer_.data();
+          buffer_ = std::move(other.buffer_);
+          other.setg(nullptr, nullptr, nullptr);
 
           setg(buffer_.data() + eback_idx,
                buffer_.data() + gptr_idx,
@@ -151,12 +193,115 @@ class file_descriptor_istream : public std::istream
           return fd_;
         }
 
+        ~file_descriptor_buffer()
+        {
+          // close any file descriptors which were received but never taken
+          for(int fd : received_file_descriptors_)
+          {
+            ::close(fd);
+          }
+        }
+
+        void attach(int fd)
+        {
+          fd_ = fd;
+        }
+
+        int take_received_file_descriptor()
+        {
+          if(received_file_descriptors_.empty())
+          {
+            if(file_descriptors_discarded_)
+            {
+              file_descriptors_discarded_ = false;
+              throw std::runtime_error("file_descriptor_istream::take_received_file_descriptor(): Received file descriptors were discarded (MSG_CTRUNC).");
+            }
+
+            return -1;
+          }
+
+          int result = received_file_descriptors_.front();
+          received_file_descriptors_.erase(received_file_descriptors_.begin());
+          return result;
+        }
+
       protected:
         constexpr const static int putback_size_ = 4;
-        constexpr const static int buffer_size_ = 1024;
+        constexpr const static int max_received_file_descriptors_ = 4;
+
+        // the buffer starts small and doubles whenever a read fills it completely, up to the maximum size
+        constexpr const static std::size_t min_buffer_size_ = 4096;
+        constexpr const static std::size_t max_buffer_size_ = 1 << 20;
 
-        std::array<char,putback_size_ + buffer_size_> buffer_;
         int fd_;
+        std::vector<char> buffer_;
+        bool is_socket_ = true;
+        bool grow_ = false;
+        bool file_descriptors_discarded_ = false;
+        std::vector<int> received_file_descriptors_;
+
+        std::size_t capacity() const
+        {
+          return buffer_.size() - putback_size_;
+        }
+
+        // reads from the file descriptor
+        // when it is a socket, also collects any file descriptors which arrive alongside the data
+        // when wait_for_all is true, a socket read waits until size bytes have arrived or the stream ends
+        inline ssize_t receive(char* data, std::size_t size, bool wait_for_all = false)
+        {
+          if(is_socket_)
+          {
+            iovec data_vector{data, size};
+            alignas(cmsghdr) char control[CMSG_SPACE(max_received_file_descriptors_ * sizeof(int))] = {};
+
+            msghdr message{};
+            message.msg_iov = &data_vector;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            ssize_t num = recvmsg(fd_, &message, MSG_CMSG_CLOEXEC | (wait_for_all ? MSG_WAITALL : 0));
+
+            if(num >= 0)
+            {
+              // the kernel discards descriptors which do not fit into control
+              if(message.msg_flags & MSG_CTRUNC)
+              {
+                file_descriptors_discarded_ = true;
+              }
+
+              for(cmsghdr* c = CMSG_FIRSTHDR(&message); c != nullptr; c = CMSG_NXTHDR(&message, c))
+              {
+                if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+                {
+                  std::size_t num_file_descriptors = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                  const unsigned char* ptr = CMSG_DATA(c);
+
+                  for(std::size_t i = 0; i < num_file_descriptors; ++i, ptr += sizeof(int))
+                  {
+                    int fd;
+                    std::memcpy(&fd, ptr, sizeof(int));
+                    received_file_descriptors_.push_back(fd);
+                  }
+                }
+              }
+
+              return num;
+            }
+
+            // control is only meaningful after a successful recvmsg()
+            if(errno != ENOTSOCK)
+            {
+              return -1;
+            }
+
+            // this file descriptor is not a socket, e.g. a pipe
+            is_socket_ = false;
+          }
+
+          return ::read(fd_, data, size);
+        }
 
         inline virtual int_type underflow()
         {
@@ -172,17 +317,35 @@ class file_descriptor_istream : public std::istream
           int num_putback = gptr() - eback();
           num_putback = std::min(num_putback, putback_size_);
 
-          // copy up to putback_size_ characters previously read
-          // into the putback area
-          std::memmove(buffer_.data() + (putback_size_ - num_putback), gptr() - num_putback, num_putback);
+          // save up to putback_size_ characters previously read
+          char putback[putback_size_];
+          std::memcpy(putback, gptr() - num_putback, num_putback);
+
+          // the previous read filled the buffer, so read more at once this time
+          if(grow_)
+          {
+            std::size_t new_capacity = 2 * capacity();
+            if(new_capacity > max_buffer_size_)
+            {
+              new_capacity = max_buffer_size_;
+            }
+
+            buffer_.resize(putback_size_ + new_capacity);
+            grow_ = false;
+          }
+
+          // restore the characters into the putback area
+          std::memcpy(buffer_.data() + (putback_size_ - num_putback), putback, num_putback);
 
-          // read at most buffer_size_ new characters
-          int num = ::read(fd_, buffer_.data() + putback_size_, buffer_size_);
+          // read at most capacity() new characters
+          ssize_t num = receive(buffer_.data() + putback_size_, capacity());
           if(num <= 0)
           {
             return traits_type::eof();
           }
 
+          grow_ = static_cast<std::size_t>(num) == capacity() && capacity() < max_buffer_size_;
+
           // reset buffer pointers
           setg(buffer_.data() + (putback_size_ - num_putback), // beginning of putback area
                buffer_.data() + putback_size_,                 // read position
@@ -191,13 +354,58 @@ class file_descriptor_istream : public std::istream
           // return next character
           return traits_type::to_int_type(*gptr());
         }
+
+        inline virtual std::streamsize xsgetn(char* s, std::streamsize n)
+        {
+          // first, take whatever is already buffered
+          std::streamsize num_copied = std::min<std::streamsize>(egptr() - gptr(), n);
+          std::memcpy(s, gptr(), num_copied);
+          setg(eback(), gptr() + num_copied, egptr());
+
+          // requests larger than the buffer bypass it and are read directly into their destination
+          if(static_cast<std::size_t>(n - num_copied) >= capacity())
+          {
+            while(num_copied < n)
+            {
+              ssize_t num = receive(s + num_copied, n - num_copied, true);
+              if(num <= 0)
+              {
+                break;
+              }
+
+              num_copied += num;
+            }
+
+            // keep the putback area consistent with the most recently read characters
+            int num_putback = std::min<std::streamsize>(num_copied, putback_size_);
+            std::memcpy(buffer_.data() + (putback_size_ - num_putback), s + num_copied - num_putback, num_putback);
+
+            setg(buffer_.data() + (putback_size_ - num_putback),
+                 buffer_.data() + putback_size_,
+                 buffer_.data() + putback_size_);
+
+            return num_copied;
+          }
+
+          // smaller requests are satisfied through the buffer
+          while(num_copied < n && underflow() != traits_type::eof())
+          {
+            std::streamsize num = std::min<std::streamsize>(egptr() - gptr(), n - num_copied);
+            std::memcpy(s + num_copied, gptr(), num);
+            setg(eback(), gptr() + num, egptr());
+
+            num_copied += num;
+          }
+
+          return num_copied;
+        }
     };
 
     file_descriptor_buffer buffer_;
 };
 
 // XXX for some reason we have to include the definition of putback_size_ here
-//     but not so for buffer_size_
+//     but not so for the other constants
 const int file_descriptor_istream::file_descriptor_buffer::putback_size_;
 
 
@@ -242,8 +450,16 @@ template<class T>
 class interprocess_future
 {
   public:
+    // the result begins as an exception, so T need not be default-constructible
+    // deserialization replaces it in place with whichever alternative arrives
     interprocess_future(int file_descriptor)
-      : is_(file_descriptor), result_or_exception_(T())
+      : is_(file_descriptor), result_or_exception_(in_place, in_place_type_t<interprocess_exception>(), broken_promise_message())
+    {}
+
+    // the future accepts its connection from the acceptor when it is first waited on,
+    // so the promise's process may connect after the future has been created
+    explicit interprocess_future(acceptor&& host)
+      : is_(-1), acceptor_(new acceptor(std::move(host))), result_or_exception_(in_place, in_place_type_t<interprocess_exception>(), broken_promise_message())
     {}
 
     interprocess_future(interprocess_future&&) = default;
@@ -292,12 +508,40 @@ class interprocess_future
         throw std::future_error(std::future_errc::no_state);
       }
 
+      if(acceptor_)
+      {
+        __TRACE_SPAN("socket_accept");
+
+        is_.attach(acceptor_->accept());
+        acceptor_.reset();
+      }
+
       if(!is_.eof())
       {
+        frame_header header;
+        if(read_frame_header(is_, header, frame_type_hash<variant<T,interprocess_exception>>()))
         {
-          input_archive ar(is_);
+          if(header.flags & frame_shared_memory)
+          {
+            // deserialize directly from the shared memory segment which accompanied the header
+            int fd = is_.take_received_file_descriptor();
+            if(fd == -1)
+            {
+              throw std::runtime_error("interprocess_future::wait(): Shared-memory frame arrived without a descriptor.");
+            }
 
-          ar(*result_or_exception_);
+            shared_memory_mapping payload(fd, header.payload_size);
+
+            deserialize_result(payload.data(), payload.size());
+          }
+          else
+          {
+            std::string payload;
+            if(read_frame_payload(is_, header, payload))
+            {
+              deserialize_result(payload.data(), payload.size());
+            }
+          }
         }
 
         is_.setstate(std::ios_base::eofbit);
@@ -310,7 +554,31 @@ class interprocess_future
     }
 
   private:
+    // the future holds this exception until a result arrives, so that get() reports a stream which ends early
+    static const char* broken_promise_message()
+    {
+      return "interprocess_future: The promise was broken before a value was received.";
+    }
+
+    void deserialize_result(const char* data, std::size_t size)
+    {
+      string_view_stream is(data, size);
+      compact_input_archive ar(is);
+
+      ar(*result_or_exception_);
+
+      if(!is)
+      {
+        // hold the failure, rather than a partially-deserialized result, and read no further
+        result_or_exception_.emplace(in_place_type_t<interprocess_exception>(), "interprocess_future: The result could not be deserialized.");
+        is_.setstate(std::ios_base::eofbit);
+
+        throw ::get<interprocess_exception>(*result_or_exception_);
+      }
+    }
+
     file_descriptor_istream is_;
+    std::unique_ptr<acceptor> acceptor_;
     optional<variant<T,interprocess_exception>> result_or_exception_;
 };
 
@@ -319,31 +587,72 @@ template<class T>
 class interprocess_promise
 {
   public:
-    interprocess_promise(std::ostream& os)
-      : os_(os)
+    interprocess_promise(std::ostream& os, std::size_t compression_threshold = default_frame_compression_threshold())
+      : os_(os), file_descriptor_(-1), is_local_socket_(false), compression_threshold_(compression_threshold)
+    {}
+
+    // the frame is written to the stream's file descriptor with a single writev(), which sends large buffers
+    // within the result directly from the result rather than from a copy
+    // when the file descriptor is an AF_UNIX socket, payloads at least as large as shared_memory_threshold
+    // are sent through shared memory instead of the socket
+    interprocess_promise(file_descriptor_ostream& os,
+                         std::size_t compression_threshold = default_frame_compression_threshold(),
+                         std::size_t shared_memory_threshold = default_shared_memory_threshold())
+      : os_(os),
+        file_descriptor_(os.file_descriptor()),
+        is_local_socket_(is_local_socket(os.file_descriptor())),
+        compression_threshold_(compression_threshold),
+        shared_memory_threshold_(shared_memory_threshold)
     {}
 
     void set_value(const T& value)
     {
-      output_archive ar(os_);
-
-      // wrap the value in a variant before transmitting
-      variant<T,interprocess_exception> value_or_exception = value;
-
-      ar(value_or_exception);
+      transmit<0>(value);
     }
 
     void set_exception(const interprocess_exception& exception)
     {
-      output_archive ar(os_);
+      transmit<1>(exception);
+    }
 
-      // wrap the exception in a variant before transmitting
-      variant<T,interprocess_exception> value_or_exception = exception;
+  private:
+    // transmits value exactly as variant<T,interprocess_exception> holding alternative index would be serialized,
+    // without first copying value into a variant
+    template<std::size_t index, class U>
+    void transmit(const U& value)
+    {
+      // large buffers within value are referenced by the payload rather than copied into it
+      gather_ostream payload;
+
+      {
+        compact_output_archive ar(payload);
+        ar(index, value);
+      }
+
+      constexpr std::uint64_t type_hash = frame_type_hash<variant<T,interprocess_exception>>();
 
-      ar(value_or_exception);
+      if(file_descriptor_ == -1)
+      {
+        write_frame(os_, payload, compression_threshold_, type_hash);
+        return;
+      }
+
+      os_.flush();
+
+      if(is_local_socket_ && payload.size() >= shared_memory_threshold_)
+      {
+        send_shared_memory_frame(file_descriptor_, payload, type_hash);
+      }
+      else
+      {
+        write_frame(file_descriptor_, payload, compression_threshold_, type_hash);
+      }
     }
 
-  private:
     std::ostream& os_;
+    int file_descriptor_;
+    bool is_local_socket_;
+    std::size_t compression_threshold_;
+    std::size_t shared_memory_threshold_ = 0;
 };
 
@@ -0,0 +1,180 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "serialization.hpp"
+#include "string_view_stream.hpp"
+
+
+// lazy<T> holds a value of type T in its serialized form and decodes it only when asked
+// receiving a lazy<T>, e.g. as a member of a result returned through an interprocess_future,
+// costs a copy of its bytes rather than a decode, so a receiver pays only for the values it inspects
+// the value is encoded with a compact_output_archive, whatever archive the lazy<T> itself travels through
+template<class T>
+class lazy
+{
+  public:
+    lazy() = default;
+
+    lazy(const T& value)
+    {
+      string_ostream os;
+
+      {
+        compact_output_archive ar(os);
+        ar(value);
+      }
+
+      bytes_ = os.release();
+    }
+
+    // decodes the value
+    T get() const
+    {
+      string_view_stream is(bytes_.data(), bytes_.size());
+      compact_input_archive ar(is);
+
+      return deserialize_construct(ar, deserialize_construct_tag<T>());
+    }
+
+    // the size of the value's encoding
+    std::size_t encoded_size() const
+    {
+      return bytes_.size();
+    }
+
+    SERIALIZABLE_MEMBERS(bytes_);
+
+  private:
+    std::string bytes_;
+};
+
+
+// lazy_vector<T> holds a sequence of values of type T in their serialized forms along with a table of their offsets,
+// so that any single element may be decoded without decoding the elements before it
+template<class T>
+class lazy_vector
+{
+  public:
+    lazy_vector()
+      : offsets_(1, 0)
+    {}
+
+    explicit lazy_vector(const std::vector<T>& values)
+      : lazy_vector()
+    {
+      reserve(values.size());
+
+      for(const T& value : values)
+      {
+        push_back(value);
+      }
+    }
+
+    void reserve(std::size_t n)
+    {
+      offsets_.reserve(n + 1);
+    }
+
+    void push_back(const T& value)
+    {
+      // encode the value directly onto the end of elements_
+      string_ostream os(std::move(elements_));
+
+      {
+        compact_output_archive ar(os);
+        ar(value);
+      }
+
+      elements_ = os.release();
+      offsets_.push_back(elements_.size());
+    }
+
+    std::size_t size() const
+    {
+      return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    bool empty() const
+    {
+      return size() == 0;
+    }
+
+    // decodes the ith element
+    T operator[](std::size_t i) const
+    {
+      std::uint64_t begin = offsets_[i];
+      std::uint64_t end = offsets_[i+1];
+
+      if(begin > end || end > elements_.size())
+      {
+        throw std::runtime_error("lazy_vector::operator[]: Invalid offset table.");
+      }
+
+      string_view_stream is(elements_.data() + begin, end - begin);
+      compact_input_archive ar(is);
+
+      return deserialize_construct(ar, deserialize_construct_tag<T>());
+    }
+
+    T at(std::size_t i) const
+    {
+      if(i >= size())
+      {
+        throw std::out_of_range("lazy_vector::at(): Index out of range.");
+      }
+
+      return (*this)[i];
+    }
+
+    // decodes every element
+    std::vector<T> get() const
+    {
+      std::vector<T> result;
+      result.reserve(size());
+
+      for(std::size_t i = 0; i < size(); ++i)
+      {
+        result.push_back((*this)[i]);
+      }
+
+      return result;
+    }
+
+    SERIALIZABLE_MEMBERS(offsets_, elements_);
+
+  private:
+    // offsets_[i] is the position of the ith element's encoding within elements_, and offsets_.back() is the end of the last
+    std::vector<std::uint64_t> offsets_;
+    std::string elements_;
+};
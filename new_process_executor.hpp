@@ -26,14 +26,14 @@
 
 #pragma once
 
-#include <limits.h>
 #include <unistd.h>
-#include <spawn.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <time.h>
 
-extern char** environ;
-
+#include <array>
 #include <cstdlib>
 #include <string>
 #include <iostream>
@@ -41,90 +41,259 @@ extern char** environ;
 #include <algorithm>
 #include <mutex>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <system_error>
 
 
 #include "interprocess_future.hpp"
 #include "active_message.hpp"
+#include "frame.hpp"
+#include "gather_stream.hpp"
+#include "process.hpp"
+#include "shared_memory.hpp"
+#include "trace.hpp"
 
 
-namespace this_process
+// this tracks all processes created through process_executors
+// and blocks on their completion in its destructor
+class process_context
 {
+  public:
+    inline ~process_context()
+    {
+      wait();
 
+      // now that every spawned process has exited, merge their traces with ours
+      trace::finalize_host();
+    }
 
-static pid_t get_id()
-{
-  return getpid();
-}
+    // a prepared_job is a function which has been serialized into a content-addressed file once
+    // executing a prepared_job repeatedly skips serialization, and passes spawned processes the file's name instead
+    // the file is removed by release(), or once no process has prepared or executed the job for max_job_file_age
+    class prepared_job
+    {
+      public:
+        // the file containing the serialized function
+        const std::string& filename() const
+        {
+          return filename_;
+        }
 
+      private:
+        friend class process_context;
 
-static const std::vector<std::string>& environment()
-{
-  static std::vector<std::string> result;
+        explicit prepared_job(const std::string& filename, bool created = false)
+          : filename_(filename),
+            variable_(std::string(file_variable_name) + "=" + filename),
+            created_(created)
+        {}
 
-  if(result.empty())
-  {
-    for(char** variable = environ; *variable; ++variable)
+        std::string filename_;
+
+        // the environment variable naming filename_
+        std::string variable_;
+
+        // whether this process wrote filename_, rather than finding it written by another
+        bool created_;
+    };
+
+    // serializes f into a cache file, or finds the file already written for an identical function
+    template<class Function>
+    prepared_job prepare(Function&& f) const
     {
-      result.push_back(std::string(*variable));
-    }
-  }
+      __TRACE_SPAN("prepare");
 
-  return result;
-}
+      active_message message(decay_copy(std::forward<Function>(f)));
 
+      std::string serialized_message = to_string(message);
 
-static const std::string& filename()
-{
-  static std::string result;
+      bool created = false;
+      std::string filename = write_job_file(serialized_message.data(), serialized_message.size(), created);
 
-  if(result.empty())
-  {
-    std::string symbolic_name = std::string("/proc/") + std::to_string(getpid()) + "/exe";
+      return prepared_job(filename, created);
+    }
 
-    char real_name[PATH_MAX + 1];
-    ssize_t length = readlink(symbolic_name.c_str(), real_name, PATH_MAX);
-    if(length == -1)
+    // removes job's file once the processes spawned so far have exited, if this process wrote it
+    // a file found already written may still be in use by the process which wrote it, so it is left to age out
+    // job must not be executed again
+    inline void release(const prepared_job& job)
     {
-      throw std::runtime_error("this_process::filename(): Error after readlink().");
+      if(job.created_)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        temporary_files_.push_back(job.filename_);
+      }
     }
 
-    real_name[length] = '\0';
+    template<class Function,
+             __REQUIRES(!std::is_same<typename std::decay<Function>::type, prepared_job>::value)>
+    void execute(const char* launcher_program_filename, const char** launcher_program_argv, Function&& f, const spawn_attributes& attributes = spawn_attributes())
+    {
+      // the spawned process finds the serialized message in the environment variable EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN
+      // serialize the message directly after the variable's name, so that the variable is complete without a copy
+      const std::string prefix = std::string(variable_name) + "=";
+      std::string variable;
 
-    result = real_name;
-  }
+      {
+        __TRACE_SPAN("serialize");
 
-  return result;
-}
+        // create an active_message out of f
+        active_message message(decay_copy(std::forward<Function>(f)));
 
+        string_ostream os{std::string(prefix)};
 
-}
+        {
+          output_archive ar(os);
+          ar(message);
+        }
 
+        variable = os.release();
+      }
 
-// this tracks all processes created through process_executors
-// and blocks on their completion in its destructor
-class process_context
-{
-  public:
-    inline ~process_context()
+      // the length of each environment variable is limited (to MAX_ARG_STRLEN on Linux),
+      // so large messages are passed through a file instead
+      const std::size_t max_environment_message_size = 1 << 16;
+      if(variable.size() - prefix.size() > max_environment_message_size)
+      {
+        // unlike a prepared_job's file, this file is used once, and is removed by wait() after the spawned process exits
+        std::string filename = write_temporary_job_file(variable.data() + prefix.size(), variable.size() - prefix.size());
+
+        try
+        {
+          spawn(launcher_program_filename, launcher_program_argv, prepared_job(filename).variable_.c_str(), attributes, filename);
+        }
+        catch(...)
+        {
+          ::unlink(filename.c_str());
+          throw;
+        }
+
+        return;
+      }
+
+      spawn(launcher_program_filename, launcher_program_argv, variable.c_str(), attributes);
+    }
+
+    inline void execute(const char* launcher_program_filename, const char** launcher_program_argv, const prepared_job& job, const spawn_attributes& attributes = spawn_attributes())
     {
-      wait();
+      // keep the file from aging out while the job is in use
+      ::utimensat(AT_FDCWD, job.filename_.c_str(), nullptr, 0);
+
+      spawn(launcher_program_filename, launcher_program_argv, job.variable_.c_str(), attributes);
     }
 
     template<class Function>
-    void execute(const char* launcher_program_filename, const char** launcher_program_argv, Function&& f)
+    interprocess_future<
+      typename std::result_of<typename std::decay<Function>::type()>::type
+    >
+      twoway_execute(const char* launcher_program_filename, const char** launcher_program_argv, Function&& f, const spawn_attributes& attributes = spawn_attributes())
+    {
+      // create a pipe whose ends are closed in spawned processes unless they are inherited explicitly,
+      // so that processes spawned concurrently by other threads never hold the output end open
+      int in_and_out_file_descriptors[2];
+      if(pipe2(in_and_out_file_descriptors, O_CLOEXEC) == -1)
+      {
+        throw std::runtime_error("process_context::twoway_execute(): Error after pipe2()");
+      }
+
+      int in = in_and_out_file_descriptors[0];
+      int out = in_and_out_file_descriptors[1];
+
+      // wrap f in a function which writes its result to the output pipe
+      invoke_and_write_result<typename std::decay<Function>::type> g{std::forward<Function>(f), out};
+
+      // only the output end is inherited by the spawned process
+      spawn_attributes attributes_with_output = attributes;
+      attributes_with_output.inherited_file_descriptors.push_back(out);
+
+      // execute the wrapped function
+      execute(launcher_program_filename, launcher_program_argv, std::move(g), attributes_with_output);
+
+      // close the output descriptor in this process
+      close(out);
+
+      // return a future
+      return interprocess_future<int>(in);
+    }
+
+    inline void wait()
     {
       std::lock_guard<std::mutex> lock(mutex_);
 
-      // create an active_message out of f
-      active_message message(decay_copy(std::forward<Function>(f)));
+      // wait for each spawned process to finish
+      for(pid_t p : processes_)
+      {
+        waitpid(p, nullptr, 0);
+      }
+
+      processes_.clear();
+
+      // no process remains to read the files of large messages or released jobs
+      for(const std::string& filename : temporary_files_)
+      {
+        ::unlink(filename.c_str());
+      }
+
+      temporary_files_.clear();
+    }
+
+  private:
+    static constexpr const char* variable_name = "EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN";
+    static constexpr const char* file_variable_name = "EXECUTE_ACTIVE_MESSAGE_FILE_BEFORE_MAIN";
+
+    static inline bool is_active_message_variable(const std::string& variable)
+    {
+      for(const char* name : {variable_name, file_variable_name})
+      {
+        std::size_t length = std::strlen(name);
+
+        if(variable.size() > length && variable.compare(0, length, name) == 0 && variable[length] == '=')
+        {
+          return true;
+        }
+      }
 
-      // make a copy of this process's environment and set the variable ALTERNATE_MAIN_ACTIVE_MESSAGE to contain serialized message
-      auto spawnee_environment = this_process::environment();
-      set_variable(spawnee_environment, "EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN", to_string(message));
-      auto spawnee_environment_view = environment_view(spawnee_environment);
+      return false;
+    }
 
+    // returns the environment of a spawned process, whose active message is named by active_message_variable
+    // the environment is built once: it is this process's environment, less any active message variables,
+    // plus the variable naming this process as the host of spawned processes' traces,
+    // followed by a single slot which each spawn fills with its own active message variable
+    // the caller must hold mutex_
+    inline char** spawnee_environment(const char* active_message_variable)
+    {
+      if(spawnee_environment_.empty())
+      {
+        for(const std::string& variable : this_process::environment())
+        {
+          if(!is_active_message_variable(variable))
+          {
+            spawnee_environment_.push_back(const_cast<char*>(variable.c_str()));
+          }
+        }
 
+        trace_host_variable_ = trace::host_variable();
+        if(!trace_host_variable_.empty())
+        {
+          spawnee_environment_.push_back(const_cast<char*>(trace_host_variable_.c_str()));
+        }
+
+        // the active message variable's slot, followed by the terminating null
+        spawnee_environment_.push_back(nullptr);
+        spawnee_environment_.push_back(nullptr);
+      }
+
+      spawnee_environment_[spawnee_environment_.size() - 2] = const_cast<char*>(active_message_variable);
+
+      return spawnee_environment_.data();
+    }
+
+    // temporary_filename, if nonempty, names a file which is removed once the spawned process has exited
+    inline void spawn(const char* launcher_program_filename, const char** launcher_program_argv, const char* active_message_variable, const spawn_attributes& attributes, const std::string& temporary_filename = std::string())
+    {
       // concatenate launchee program filename onto launcher_argv
       std::vector<const char*> args;
 
@@ -139,73 +308,206 @@ class process_context
       args.push_back(nullptr);
 
       // spawn the process
-      pid_t spawnee_id;
-      int error = posix_spawnp(&spawnee_id, launcher_program_filename, nullptr, nullptr, const_cast<char**>(args.data()), spawnee_environment_view.data());
-      if(error)
-      {
-        throw std::system_error(errno, std::generic_category(), "process_context::execute(): Error after posix_spawn()");
-      }
+      __TRACE_SPAN("spawn");
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      pid_t spawnee_id = spawn_process(launcher_program_filename, const_cast<char**>(args.data()), spawnee_environment(active_message_variable), attributes);
 
       // keep track of the new process
       processes_.push_back(spawnee_id);
+
+      if(!temporary_filename.empty())
+      {
+        temporary_files_.push_back(temporary_filename);
+      }
     }
 
-    template<class Function>
-    interprocess_future<
-      typename std::result_of<typename std::decay<Function>::type()>::type
-    >
-      twoway_execute(const char* launcher_program_filename, const char** launcher_program_argv, Function&& f)
+    // job files which no process has prepared or executed for this long are removed,
+    // as are temporary files abandoned by processes which died while writing them
+    static constexpr time_t max_job_file_age = 7 * 24 * 60 * 60;
+    static constexpr time_t max_temporary_file_age = 60 * 60;
+
+    // removes the files in directory which have aged out
+    static inline void remove_stale_job_files(const std::string& directory)
     {
-      // create a pipe
-      int in_and_out_file_descriptors[2];
-      if(pipe(in_and_out_file_descriptors) == -1)
+      DIR* dir = opendir(directory.c_str());
+      if(!dir)
       {
-        throw std::runtime_error("process_context::twoway_execute(): Error after pipe()");
+        return;
       }
 
-      int in = in_and_out_file_descriptors[0];
-      int out = in_and_out_file_descriptors[1];
+      time_t now = time(nullptr);
 
-      // wrap f in a function which writes its result to the output pipe
-      invoke_and_write_result<typename std::decay<Function>::type> g{std::forward<Function>(f), out};
+      while(dirent* entry = readdir(dir))
+      {
+        std::string name = entry->d_name;
+
+        time_t max_age = 0;
+        if(name.compare(0, 4, "job-") == 0)
+        {
+          max_age = max_job_file_age;
+        }
+        else if(name.compare(0, 4, "tmp-") == 0)
+        {
+          max_age = max_temporary_file_age;
+        }
+        else
+        {
+          continue;
+        }
 
-      // ensure that the input file is closed in the spawned process
-      int flags = fcntl(in, F_GETFD);
-      if(flags == -1)
+        struct stat status;
+        if(fstatat(dirfd(dir), name.c_str(), &status, AT_SYMLINK_NOFOLLOW) == 0 && now - status.st_mtime > max_age)
+        {
+          unlinkat(dirfd(dir), name.c_str(), 0);
+        }
+      }
+
+      closedir(dir);
+    }
+
+    // the directory holding prepared jobs, $TMPDIR/shmem_executor-<uid>, is private to this user,
+    // because spawned processes trust the contents of the files within it
+    // the first time a process uses the directory, it removes the files which have aged out
+    static inline std::string job_directory()
+    {
+      const char* tmpdir = std::getenv("TMPDIR");
+      std::string result = std::string(tmpdir ? tmpdir : "/tmp") + "/shmem_executor-" + std::to_string(geteuid());
+
+      if(mkdir(result.c_str(), 0700) == -1 && errno != EEXIST)
       {
-        throw std::runtime_error("process::twoway_executor(): Error after fctnl()");
+        throw std::system_error(errno, std::system_category(), "process_context::job_directory(): Error after mkdir()");
       }
 
-      flags |= FD_CLOEXEC;
-      if(fcntl(in, F_SETFD, flags) == -1)
+      struct stat status;
+      if(lstat(result.c_str(), &status) == -1)
       {
-        throw std::runtime_error("process::twoway_executor(): Error after fctnl()");
+        throw std::system_error(errno, std::system_category(), "process_context::job_directory(): Error after lstat()");
       }
 
-      // execute the wrapped function
-      execute(launcher_program_filename, launcher_program_argv, std::move(g));
+      if(!S_ISDIR(status.st_mode) || status.st_uid != geteuid() || (status.st_mode & (S_IRWXG | S_IRWXO)))
+      {
+        throw std::runtime_error("process_context::job_directory(): " + result + " is not a private directory.");
+      }
 
-      // close the output descriptor in this process
-      close(out);
+      static const bool removed_stale_files = (remove_stale_job_files(result), true);
+      (void)removed_stale_files;
 
-      // return a future
-      return interprocess_future<int>(in);
+      return result;
     }
 
-    inline void wait()
+    // creates a uniquely-named file in the job directory which holds [data, data + size) and returns its name
+    static inline std::string write_temporary_job_file(const char* data, std::size_t size)
     {
-      std::lock_guard<std::mutex> lock(mutex_);
+      std::string filename = job_directory() + "/tmp-XXXXXX";
 
-      // wait for each spawned process to finish
-      for(pid_t p : processes_)
+      int fd = mkostemp(&filename[0], O_CLOEXEC);
+      if(fd == -1)
       {
-        waitpid(p, nullptr, 0);
+        throw std::system_error(errno, std::system_category(), "process_context::write_temporary_job_file(): Error after mkostemp()");
       }
 
-      processes_.clear();
+      try
+      {
+        write_segments(fd, std::vector<iovec>{iovec{const_cast<char*>(data), size}});
+      }
+      catch(...)
+      {
+        ::close(fd);
+        ::unlink(filename.c_str());
+        throw;
+      }
+
+      ::close(fd);
+
+      return filename;
+    }
+
+    // returns true if the file named filename holds exactly [data, data + size)
+    static inline bool file_holds(const std::string& filename, const char* data, std::size_t size)
+    {
+      int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd == -1)
+      {
+        return false;
+      }
+
+      struct stat status;
+      if(fstat(fd, &status) == -1 || static_cast<std::size_t>(status.st_size) != size)
+      {
+        ::close(fd);
+        return false;
+      }
+
+      shared_memory_mapping mapping(fd, size);
+
+      return size == 0 || std::memcmp(mapping.data(), data, size) == 0;
+    }
+
+    // writes contents to a file named by their hash and returns the file's name
+    // the files outlive this process, so later launches of an identical function, even from other processes, find them already written
+    // created is set when this call published the file, rather than finding it already written
+    static inline std::string write_job_file(const char* data, std::size_t size, bool& created)
+    {
+      char hash[17];
+      std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(fnv1a_hash(data, data + size)));
+
+      std::string base_filename = job_directory() + "/job-" + hash;
+
+      // the contents are written once, to a temporary file which is then published under its final name
+      std::string temporary_filename;
+
+      // files whose hashes collide are distinguished by a suffix
+      for(int suffix = 0; ; ++suffix)
+      {
+        std::string filename = suffix == 0 ? base_filename : base_filename + "-" + std::to_string(suffix);
+
+        // compare the bytes of an existing file, because its name only identifies its hash
+        if(file_holds(filename, data, size))
+        {
+          if(!temporary_filename.empty())
+          {
+            ::unlink(temporary_filename.c_str());
+          }
+
+          // keep the file from aging out while the job is in use
+          ::utimensat(AT_FDCWD, filename.c_str(), nullptr, 0);
+
+          return filename;
+        }
+
+        if(::access(filename.c_str(), F_OK) == 0)
+        {
+          // a different job with the same hash occupies this name
+          continue;
+        }
+
+        if(temporary_filename.empty())
+        {
+          temporary_filename = write_temporary_job_file(data, size);
+        }
+
+        // unlike rename(), link() never replaces an existing file,
+        // so no process ever observes a partially-written job or loses a job it has published
+        if(::link(temporary_filename.c_str(), filename.c_str()) == 0)
+        {
+          ::unlink(temporary_filename.c_str());
+          created = true;
+          return filename;
+        }
+
+        if(errno != EEXIST)
+        {
+          int error = errno;
+          ::unlink(temporary_filename.c_str());
+          throw std::system_error(error, std::system_category(), "process_context::write_job_file(): Error after link()");
+        }
+
+        // another thread or process published a file under this name first, so examine it again
+        --suffix;
+      }
     }
 
-  private:
     template<class Function>
     struct invoke_and_write_result
     {
@@ -230,59 +532,9 @@ class process_context
         ::close(file_descriptor);
       }
 
-      template<class OutputArchive>
-      friend void serialize(OutputArchive& ar, const invoke_and_write_result& self)
-      {
-        ar(self.f, self.file_descriptor);
-      }
-
-      template<class InputArchive>
-      friend void deserialize(InputArchive& ar, invoke_and_write_result& self)
-      {
-        ar(self.f, self.file_descriptor);
-      }
+      SERIALIZABLE_MEMBERS(f, file_descriptor);
     };
 
-    static inline void set_variable(std::vector<std::string>& environment, const std::string& variable, const std::string& value)
-    {
-      auto existing_variable = std::find_if(environment.begin(), environment.end(), [&](const std::string& current_variable)
-      {
-        // check if variable is a prefix of current_variable
-        auto result = std::mismatch(variable.begin(), variable.end(), current_variable.begin());
-        if(result.first == variable.end())
-        {
-          // check if the next character after the prefix is an equal sign
-          return result.second != variable.end() && *result.second == '=';
-        }
-    
-        return false;
-      });
-    
-      if(existing_variable != environment.end())
-      {
-        *existing_variable = variable + "=" + value;
-      }
-      else
-      {
-        environment.emplace_back(variable + "=" + value);
-      }
-    }
-    
-    static inline std::vector<char*> environment_view(const std::vector<std::string>& environment)
-    {
-      std::vector<char*> result;
-    
-      for(const std::string& variable : environment)
-      {
-        result.push_back(const_cast<char*>(variable.c_str()));
-      }
-
-      // the view is assumed to be null-terminated
-      result.push_back(0);
-    
-      return result;
-    }
-
     template<class Arg>
     static typename std::decay<Arg>::type decay_copy(Arg&& arg)
     {
@@ -291,26 +543,73 @@ class process_context
 
     std::mutex mutex_;
     std::vector<pid_t> processes_;
+    std::vector<char*> spawnee_environment_;
+    std::string trace_host_variable_;
+    std::vector<std::string> temporary_files_;
 };
 
 process_context global_process_context;
 
 
 // this replaces a process's execution of main() with an active_message if
-// the environment variable EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN is defined
+// the environment variable EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN is defined,
+// or with the active_message in the file named by EXECUTE_ACTIVE_MESSAGE_FILE_BEFORE_MAIN
 struct execute_active_message_before_main_if
 {
   execute_active_message_before_main_if()
   {
     char* variable = std::getenv("EXECUTE_ACTIVE_MESSAGE_BEFORE_MAIN");
-    if(variable)
+    char* filename = std::getenv("EXECUTE_ACTIVE_MESSAGE_FILE_BEFORE_MAIN");
+    if(variable || filename)
     {
-      active_message message = from_string<active_message>(variable);
-      message.activate();
+      {
+        __TRACE_SPAN("activate");
+
+        active_message message;
+
+        {
+          __TRACE_SPAN("deserialize");
+
+          if(variable)
+          {
+            message = from_string<active_message>(variable);
+          }
+          else
+          {
+            message = read_message_file(filename);
+          }
+        }
+
+        message.activate();
+      }
+
+      trace::finalize_spawned_process();
 
       std::exit(EXIT_SUCCESS);
     }
   }
+
+  // maps the file written by process_context::prepare() and deserializes its message directly from the mapping
+  static active_message read_message_file(const char* filename)
+  {
+    int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+    {
+      throw std::system_error(errno, std::system_category(), "execute_active_message_before_main_if::read_message_file(): Error after open()");
+    }
+
+    struct stat status;
+    if(fstat(fd, &status) == -1)
+    {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::system_category(), "execute_active_message_before_main_if::read_message_file(): Error after fstat()");
+    }
+
+    shared_memory_mapping mapping(fd, status.st_size);
+
+    return from_string<active_message>(mapping.data(), mapping.size());
+  }
 };
 
 execute_active_message_before_main_if before_main{};
@@ -320,19 +619,47 @@ class new_process_executor
 {
   public:
     template<class RangeOfConstChar>
-    explicit new_process_executor(const char* launcher_program_filename, const RangeOfConstChar& launcher_program_argv)
+    explicit new_process_executor(const char* launcher_program_filename, const RangeOfConstChar& launcher_program_argv, const spawn_attributes& attributes = spawn_attributes())
       : launcher_program_filename_(launcher_program_filename),
-        launcher_program_argv_(launcher_program_argv.begin(), launcher_program_argv.end())
+        launcher_program_argv_(launcher_program_argv.begin(), launcher_program_argv.end()),
+        attributes_(attributes)
     {}
 
-    new_process_executor()
-      : new_process_executor("/usr/bin/env", std::array<const char*,2>{"/usr/bin/env", nullptr})
+    explicit new_process_executor(const spawn_attributes& attributes = spawn_attributes())
+      : new_process_executor("/usr/bin/env", std::array<const char*,2>{"/usr/bin/env", nullptr}, attributes)
     {}
 
-    template<class Function>
+    // the attributes with which this executor spawns processes
+    const spawn_attributes& attributes() const
+    {
+      return attributes_;
+    }
+
+    using prepared_job = process_context::prepared_job;
+
+    template<class Function,
+             __REQUIRES(!std::is_same<typename std::decay<Function>::type, prepared_job>::value)>
     void execute(Function&& f) const
     {
-      global_process_context.execute(launcher_program_filename_.c_str(), const_cast<const char**>(launcher_program_argv_.data()), std::forward<Function>(f));
+      global_process_context.execute(launcher_program_filename_.c_str(), const_cast<const char**>(launcher_program_argv_.data()), std::forward<Function>(f), attributes_);
+    }
+
+    // serializes f once, so that it may be executed repeatedly through execute(const prepared_job&)
+    template<class Function>
+    prepared_job prepare(Function&& f) const
+    {
+      return global_process_context.prepare(std::forward<Function>(f));
+    }
+
+    void execute(const prepared_job& job) const
+    {
+      global_process_context.execute(launcher_program_filename_.c_str(), const_cast<const char**>(launcher_program_argv_.data()), job, attributes_);
+    }
+
+    // removes job's file once the processes executing it have exited; job must not be executed again
+    void release(const prepared_job& job) const
+    {
+      global_process_context.release(job);
     }
     
     template<class Function>
@@ -341,11 +668,12 @@ class new_process_executor
     >
       twoway_execute(Function&& f) const
     {
-      return global_process_context.twoway_execute(launcher_program_filename_.c_str(), const_cast<const char**>(launcher_program_argv_.data()), std::forward<Function>(f));
+      return global_process_context.twoway_execute(launcher_program_filename_.c_str(), const_cast<const char**>(launcher_program_argv_.data()), std::forward<Function>(f), attributes_);
     }
 
   private:
     std::string launcher_program_filename_;
     std::vector<const char*> launcher_program_argv_;
+    spawn_attributes attributes_;
 };
 
@@ -26,10 +26,19 @@
 
 #pragma once
 
-#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <vector>
 
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 extern char** environ;
@@ -86,3 +95,210 @@ static inline const std::string& filename()
 
 }
 
+
+// posix_spawn_file_actions_adddup2(fd, fd) clears fd's close-on-exec flag in the spawned process only since glibc 2.29;
+// earlier versions skip the dup2() and leave the descriptor to be closed on exec
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if !__GLIBC_PREREQ(2, 29)
+#define __POSIX_SPAWN_CLOSES_INHERITED_FILE_DESCRIPTORS
+#endif
+#endif
+
+
+// spawn_attributes control how spawn_process() creates a process
+struct spawn_attributes
+{
+  enum backend_type
+  {
+    // posix_spawn(), which glibc implements with clone(CLONE_VM | CLONE_VFORK)
+    posix_spawn_backend,
+
+    // vfork(), after which the child applies the attributes below itself before exec
+    vfork_backend
+  };
+
+  spawn_attributes()
+    : backend(posix_spawn_backend)
+  {}
+
+  backend_type backend;
+
+  // descriptors which the spawned process inherits, even if they are close-on-exec in this process
+  std::vector<int> inherited_file_descriptors;
+
+  // if nonempty, the CPUs to which the spawned process is bound
+  std::vector<int> cpu_affinity;
+
+  // if nonempty, the cgroup directory into which the spawned process is placed, e.g. /sys/fs/cgroup/workers
+  std::string cgroup;
+
+  // posix_spawn() cannot bind a process to CPUs or place it into a cgroup, so these require vfork_backend,
+  // as do inherited descriptors when posix_spawn() cannot clear their close-on-exec flags
+  bool requires_vfork() const
+  {
+#if defined(__POSIX_SPAWN_CLOSES_INHERITED_FILE_DESCRIPTORS)
+    if(!inherited_file_descriptors.empty()) return true;
+#endif
+
+    return backend == vfork_backend || !cpu_affinity.empty() || !cgroup.empty();
+  }
+};
+
+
+namespace detail
+{
+
+
+inline pid_t posix_spawn_process(const char* filename, char* const* argv, char* const* envp, const spawn_attributes& attributes)
+{
+  posix_spawn_file_actions_t file_actions;
+  int error = posix_spawn_file_actions_init(&file_actions);
+  if(error)
+  {
+    throw std::system_error(error, std::generic_category(), "spawn_process(): Error after posix_spawn_file_actions_init()");
+  }
+
+  // duplicating a descriptor onto itself clears its close-on-exec flag in the spawned process only
+  for(int fd : attributes.inherited_file_descriptors)
+  {
+    if(!error)
+    {
+      error = posix_spawn_file_actions_adddup2(&file_actions, fd, fd);
+    }
+  }
+
+  pid_t result = -1;
+
+  if(!error)
+  {
+    error = posix_spawnp(&result, filename, &file_actions, nullptr, argv, envp);
+  }
+
+  posix_spawn_file_actions_destroy(&file_actions);
+
+  if(error)
+  {
+    throw std::system_error(error, std::generic_category(), "spawn_process(): Error after posix_spawnp()");
+  }
+
+  return result;
+}
+
+
+inline pid_t vfork_spawn_process(const char* filename, char* const* argv, char* const* envp, const spawn_attributes& attributes)
+{
+  // prepare everything the child needs before vfork(), so that the child makes only system calls
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for(int cpu : attributes.cpu_affinity)
+  {
+    if(cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      throw std::invalid_argument("spawn_process(): Invalid CPU in cpu_affinity.");
+    }
+
+    CPU_SET(cpu, &cpus);
+  }
+
+  int cgroup_processes = -1;
+  if(!attributes.cgroup.empty())
+  {
+    cgroup_processes = ::open((attributes.cgroup + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if(cgroup_processes == -1)
+    {
+      throw std::system_error(errno, std::system_category(), "spawn_process(): Error after open()");
+    }
+  }
+
+  // the child shares this process's memory until it execs,
+  // so block signals to ensure that none of this process's handlers run in the child
+  sigset_t all_signals, previous_signals;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &previous_signals);
+
+  // the child reports an error before exec through this variable
+  volatile int child_error = 0;
+
+  pid_t result = vfork();
+  if(result == 0)
+  {
+    // restore the default disposition of each handled signal before unblocking signals
+    struct sigaction default_action{};
+    default_action.sa_handler = SIG_DFL;
+    sigemptyset(&default_action.sa_mask);
+
+    for(int signal_number = 1; signal_number < NSIG; ++signal_number)
+    {
+      struct sigaction action;
+      if(sigaction(signal_number, nullptr, &action) == 0 && action.sa_handler != SIG_IGN && action.sa_handler != SIG_DFL)
+      {
+        sigaction(signal_number, &default_action, nullptr);
+      }
+    }
+
+    // the child has its own descriptor table, so clearing close-on-exec does not affect this process
+    for(int fd : attributes.inherited_file_descriptors)
+    {
+      int flags = fcntl(fd, F_GETFD);
+      if(flags == -1 || fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) == -1)
+      {
+        child_error = errno;
+        _exit(127);
+      }
+    }
+
+    if(!attributes.cpu_affinity.empty() && sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+    {
+      child_error = errno;
+      _exit(127);
+    }
+
+    // writing 0 to cgroup.procs moves the writer into the cgroup
+    if(cgroup_processes != -1 && ::write(cgroup_processes, "0", 1) == -1)
+    {
+      child_error = errno;
+      _exit(127);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+
+    execvpe(filename, argv, envp);
+
+    child_error = errno;
+    _exit(127);
+  }
+
+  int vfork_error = errno;
+
+  pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+
+  if(cgroup_processes != -1)
+  {
+    ::close(cgroup_processes);
+  }
+
+  if(result == -1)
+  {
+    throw std::system_error(vfork_error, std::system_category(), "spawn_process(): Error after vfork()");
+  }
+
+  if(child_error)
+  {
+    waitpid(result, nullptr, 0);
+    throw std::system_error(child_error, std::system_category(), "spawn_process(): Error in child before execvpe()");
+  }
+
+  return result;
+}
+
+
+} // end detail
+
+
+// spawns the program filename, which is searched for in PATH unless it contains a slash, and returns its process id
+inline pid_t spawn_process(const char* filename, char* const* argv, char* const* envp, const spawn_attributes& attributes = spawn_attributes())
+{
+  return attributes.requires_vfork() ?
+    detail::vfork_spawn_process(filename, argv, envp, attributes) :
+    detail::posix_spawn_process(filename, argv, envp, attributes);
+}
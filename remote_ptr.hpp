@@ -26,13 +26,131 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <type_traits>
+#include <vector>
 #include <shmem.h>
 
 #include "pointer_adaptor.hpp"
 
 #define __REQUIRES(...) typename std::enable_if<(__VA_ARGS__)>::type* = nullptr
 
+// remote_memory_counters tallies the traffic generated through remote_memory_accessors
+class remote_memory_counters
+{
+  public:
+    remote_memory_counters()
+      : remote_memory_counters(0)
+    {}
+
+    explicit remote_memory_counters(size_t num_processing_elements)
+      : num_gets_(0),
+        num_puts_(0),
+        bytes_gotten_(0),
+        bytes_put_(0),
+        accesses_per_processing_element_(num_processing_elements)
+    {}
+
+    remote_memory_counters(size_t num_gets, size_t num_puts, size_t bytes_gotten, size_t bytes_put, const std::vector<size_t>& accesses_per_processing_element)
+      : num_gets_(num_gets),
+        num_puts_(num_puts),
+        bytes_gotten_(bytes_gotten),
+        bytes_put_(bytes_put),
+        accesses_per_processing_element_(accesses_per_processing_element)
+    {}
+
+    void record_get(int processing_element, size_t num_bytes)
+    {
+      ++num_gets_;
+      bytes_gotten_ += num_bytes;
+      record_access(processing_element);
+    }
+
+    void record_put(int processing_element, size_t num_bytes)
+    {
+      ++num_puts_;
+      bytes_put_ += num_bytes;
+      record_access(processing_element);
+    }
+
+    size_t num_gets() const
+    {
+      return num_gets_;
+    }
+
+    size_t num_puts() const
+    {
+      return num_puts_;
+    }
+
+    size_t bytes_gotten() const
+    {
+      return bytes_gotten_;
+    }
+
+    size_t bytes_put() const
+    {
+      return bytes_put_;
+    }
+
+    // the number of gets and puts which targeted each processing element
+    const std::vector<size_t>& accesses_per_processing_element() const
+    {
+      return accesses_per_processing_element_;
+    }
+
+    remote_memory_counters& operator+=(const remote_memory_counters& other)
+    {
+      num_gets_ += other.num_gets_;
+      num_puts_ += other.num_puts_;
+      bytes_gotten_ += other.bytes_gotten_;
+      bytes_put_ += other.bytes_put_;
+
+      if(accesses_per_processing_element_.size() < other.accesses_per_processing_element_.size())
+      {
+        accesses_per_processing_element_.resize(other.accesses_per_processing_element_.size());
+      }
+
+      for(size_t i = 0; i < other.accesses_per_processing_element_.size(); ++i)
+      {
+        accesses_per_processing_element_[i] += other.accesses_per_processing_element_[i];
+      }
+
+      return *this;
+    }
+
+    template<class OutputArchive>
+    friend void serialize(OutputArchive& ar, const remote_memory_counters& self)
+    {
+      ar(self.num_gets_, self.num_puts_, self.bytes_gotten_, self.bytes_put_, self.accesses_per_processing_element_);
+    }
+
+    template<class InputArchive>
+    friend void deserialize(InputArchive& ar, remote_memory_counters& self)
+    {
+      ar(self.num_gets_, self.num_puts_, self.bytes_gotten_, self.bytes_put_, self.accesses_per_processing_element_);
+    }
+
+  private:
+    void record_access(int processing_element)
+    {
+      if(accesses_per_processing_element_.size() <= static_cast<size_t>(processing_element))
+      {
+        accesses_per_processing_element_.resize(processing_element + 1);
+      }
+
+      ++accesses_per_processing_element_[processing_element];
+    }
+
+    size_t num_gets_;
+    size_t num_puts_;
+    size_t bytes_gotten_;
+    size_t bytes_put_;
+    std::vector<size_t> accesses_per_processing_element_;
+};
+
 class remote_memory_accessor
 {
   public:
@@ -52,6 +170,11 @@ class remote_memory_accessor
             )>
     T load(const T* ptr) const
     {
+      if(remote_memory_counters* counters = this_thread_counters())
+      {
+        counters->record_get(processing_element(), sizeof(T));
+      }
+
       T result;
       shmem_getmem(&result, ptr, sizeof(T), processing_element());
       return result;
@@ -60,10 +183,111 @@ class remote_memory_accessor
     template<class T, __REQUIRES(std::is_trivially_copyable<T>::value)>
     void store(T* ptr, const T& value) const
     {
+      if(remote_memory_counters* counters = this_thread_counters())
+      {
+        counters->record_put(processing_element(), sizeof(T));
+      }
+
       shmem_putmem(ptr, &value, sizeof(T), processing_element());
     }
 
+    // counting is opt-in: after count_into(counters), every load and store through any remote_memory_accessor
+    // in this process is recorded into counters. count_into(nullptr) stops counting
+    // each thread records into counters of its own, which are merged into counters when counting stops
+    // or when the thread exits, so threads sharing a processing element may count concurrently
+    // counting must not stop while other threads are still accessing remote memory
+    static void count_into(remote_memory_counters* counters)
+    {
+      counting_state& state = counting();
+      std::lock_guard<std::mutex> lock(state.mutex);
+
+      for(thread_counters* t : state.threads)
+      {
+        *state.target += t->counters;
+      }
+
+      state.threads.clear();
+      state.target = counters;
+
+      // a new generation causes each thread to begin its counters anew
+      state.generation = counters ? ++state.num_generations : 0;
+      state.active_generation.store(state.generation, std::memory_order_release);
+    }
+
   private:
+    // a thread's counters during a single generation of counting
+    struct thread_counters
+    {
+      remote_memory_counters counters;
+      unsigned long long generation = 0;
+
+      // a thread which exits while counting contributes what it has counted
+      ~thread_counters()
+      {
+        counting_state& state = counting();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if(generation != 0 && generation == state.generation)
+        {
+          *state.target += counters;
+          state.threads.erase(std::find(state.threads.begin(), state.threads.end(), this));
+        }
+      }
+    };
+
+    struct counting_state
+    {
+      std::mutex mutex;
+
+      // the counters into which threads' counters are merged, and the threads which have counted into them
+      remote_memory_counters* target = nullptr;
+      std::vector<thread_counters*> threads;
+
+      // the current generation of counting, or 0 when counting has stopped
+      unsigned long long generation = 0;
+      unsigned long long num_generations = 0;
+      std::atomic<unsigned long long> active_generation{0};
+    };
+
+    static counting_state& counting()
+    {
+      // the state is intentionally never destroyed, because threads' counters may be destroyed after static objects
+      static counting_state* result = new counting_state;
+      return *result;
+    }
+
+    // returns the calling thread's counters, or nullptr when counting has stopped
+    static remote_memory_counters* this_thread_counters()
+    {
+      counting_state& state = counting();
+
+      unsigned long long generation = state.active_generation.load(std::memory_order_acquire);
+      if(generation == 0)
+      {
+        return nullptr;
+      }
+
+      thread_local thread_counters result;
+
+      // the first access of each generation registers this thread's counters to be merged
+      if(result.generation != generation)
+      {
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        // counting may have stopped in the meantime
+        if(state.generation == 0)
+        {
+          return nullptr;
+        }
+
+        result.counters = remote_memory_counters();
+        result.generation = state.generation;
+        state.threads.push_back(&result);
+      }
+
+      return &result.counters;
+    }
+
     int processing_element_;
 };
 
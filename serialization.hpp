@@ -32,9 +32,15 @@
 #include <typeinfo>
 #include <sstream>
 #include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include <utility>
 #include "string_view_stream.hpp"
+#include "gather_stream.hpp"
 #include "tuple.hpp"
 #include "variant.hpp"
+#include "optional.hpp"
 
 
 #define __REQUIRES(...) typename std::enable_if<(__VA_ARGS__)>::type* = nullptr
@@ -43,13 +49,98 @@
 // this serialization scheme is based on Cereal
 // see http://uscilab.github.io/cereal
 
+
+// SERIALIZABLE_MEMBERS lists the members through which a type is serialized, in order,
+// so the type needs no hand-written serialize and deserialize functions:
+//
+//     struct point
+//     {
+//       int x, y;
+//
+//       SERIALIZABLE_MEMBERS(x, y);
+//     };
+//
+// the macro may appear in any access section, and when a type's listed members are all arithmetic
+// and fill it exactly, compact archives encode it as its bytes with a single copy
+// XXX a type deriving from a type which uses the macro must list its members with the macro as well
+#define SERIALIZABLE_MEMBERS(...) \
+  friend struct ::serializable_members_access; \
+  template<class OutputArchive> \
+  void serialize_members(OutputArchive& ar) const \
+  { \
+    serialize_member_list(ar, *this, __VA_ARGS__); \
+  } \
+  template<class InputArchive> \
+  void deserialize_members(InputArchive& ar) \
+  { \
+    deserialize_member_list(ar, *this, __VA_ARGS__); \
+  } \
+  using serializable_members_tag = void
+
+
+// serializable_members_access is befriended by each type using SERIALIZABLE_MEMBERS
+struct serializable_members_access
+{
+  template<class T>
+  struct has_serializable_members
+  {
+    template<class U, class = typename U::serializable_members_tag>
+    static std::true_type test(int);
+
+    template<class>
+    static std::false_type test(...);
+
+    using type = decltype(test<T>(0));
+  };
+
+  template<class OutputArchive, class T>
+  static void serialize(OutputArchive& ar, const T& value)
+  {
+    value.serialize_members(ar);
+  }
+
+  template<class InputArchive, class T>
+  static void deserialize(InputArchive& ar, T& value)
+  {
+    value.deserialize_members(ar);
+  }
+};
+
+template<class T>
+using has_serializable_members = typename serializable_members_access::has_serializable_members<T>::type;
+
+
 template<class OutputArchive, class T>
-void serialize(OutputArchive& ar, const T& value)
+void serialize_formatted(OutputArchive& ar, const T& value)
 {
-  // by default, use formatted output, and follow with whitespace
+  // follow the formatted value with whitespace
   ar.stream() << value << " ";
 }
 
+template<class OutputArchive, class T,
+         __REQUIRES(!has_serializable_members<T>::value),
+         __REQUIRES(!std::is_enum<T>::value)>
+void serialize(OutputArchive& ar, const T& value)
+{
+  // by default, use formatted output
+  serialize_formatted(ar, value);
+}
+
+template<class OutputArchive, class T,
+         __REQUIRES(std::is_enum<T>::value)>
+void serialize(OutputArchive& ar, const T& value)
+{
+  using underlying_type = typename std::underlying_type<T>::type;
+  ar(static_cast<underlying_type>(value));
+}
+
+template<class OutputArchive, class T,
+         __REQUIRES(has_serializable_members<T>::value)>
+void serialize(OutputArchive& ar, const T& value)
+{
+  serializable_members_access::serialize(ar, value);
+}
+
 template<class OutputArchive, class Result, class... Args>
 void serialize(OutputArchive& ar, Result (*const &fun_ptr)(Args...))
 {
@@ -65,17 +156,43 @@ void serialize(OutputArchive& ar, const std::string& s)
   serialize(ar, s.size());
 
   // output the bytes
-  ar.stream().write(s.data(), s.size());
+  write_contiguous(ar.stream(), s.data(), s.size());
 }
 
 
 template<class InputArchive, class T>
-void deserialize(InputArchive& ar, T& value)
+void deserialize_formatted(InputArchive& ar, T& value)
 {
-  // by default, use formatted input, and consume trailing whitespace
+  // consume the trailing whitespace
   ar.stream() >> value >> std::ws;
 }
 
+template<class InputArchive, class T,
+         __REQUIRES(!has_serializable_members<T>::value),
+         __REQUIRES(!std::is_enum<T>::value)>
+void deserialize(InputArchive& ar, T& value)
+{
+  // by default, use formatted input
+  deserialize_formatted(ar, value);
+}
+
+template<class InputArchive, class T,
+         __REQUIRES(std::is_enum<T>::value)>
+void deserialize(InputArchive& ar, T& value)
+{
+  typename std::underlying_type<T>::type underlying_value;
+  ar(underlying_value);
+
+  value = static_cast<T>(underlying_value);
+}
+
+template<class InputArchive, class T,
+         __REQUIRES(has_serializable_members<T>::value)>
+void deserialize(InputArchive& ar, T& value)
+{
+  serializable_members_access::deserialize(ar, value);
+}
+
 template<class InputArchive, class T,
          __REQUIRES(!std::is_void<T>::value)>
 void deserialize(InputArchive& ar, T*& ptr)
@@ -148,6 +265,50 @@ void deserialize(InputArchive& ar, std::tuple<Ts...>& tuple)
 }
 
 
+template<class OutputArchive, class T1, class T2>
+void serialize(OutputArchive& ar, const std::pair<T1,T2>& pair)
+{
+  serialize(ar, pair.first);
+  serialize(ar, pair.second);
+}
+
+template<class InputArchive, class T1, class T2>
+void deserialize(InputArchive& ar, std::pair<T1,T2>& pair)
+{
+  deserialize(ar, pair.first);
+  deserialize(ar, pair.second);
+}
+
+
+template<class OutputArchive, class T>
+void serialize(OutputArchive& ar, const std::vector<T>& vector)
+{
+  // output the length
+  serialize(ar, vector.size());
+
+  // output each element
+  for(const T& element : vector)
+  {
+    serialize(ar, element);
+  }
+}
+
+template<class InputArchive, class T>
+void deserialize(InputArchive& ar, std::vector<T>& vector)
+{
+  // read the length and resize the vector
+  std::size_t length = 0;
+  deserialize(ar, length);
+  vector.resize(length);
+
+  // read each element
+  for(T& element : vector)
+  {
+    deserialize(ar, element);
+  }
+}
+
+
 template<class OutputArchive>
 struct serialize_visitor
 {
@@ -172,25 +333,72 @@ void serialize(OutputArchive& ar, const variant<Types...>& v)
 }
 
 
-template<size_t i, class InputArchive, class... Ts, __REQUIRES(i == sizeof...(Ts))>
-void deserialize_variant_impl(InputArchive& ar, size_t index, variant<Ts...>& v)
+// deserialize_construct returns a T constructed from the next value of an archive
+// it is the customization point through which types that are not default-constructible are deserialized:
+// such a type provides an overload of deserialize_construct(InputArchive&, deserialize_construct_tag<T>),
+// which is found through argument-dependent lookup
+// XXX such an overload must read exactly what serialize(OutputArchive&, const T&) wrote
+template<class T>
+struct deserialize_construct_tag {};
+
+template<class InputArchive, class T,
+         __REQUIRES(std::is_default_constructible<T>::value)>
+T deserialize_construct(InputArchive& ar, deserialize_construct_tag<T>)
+{
+  T result{};
+  ar(result);
+  return result;
+}
+
+
+// alternatives which are default-constructible are constructed in the variant's storage and deserialized in place
+template<size_t i, class InputArchive, class... Ts,
+         __REQUIRES(std::is_default_constructible<variant_alternative_t<i, variant<Ts...>>>::value)>
+void deserialize_variant_alternative(InputArchive& ar, variant<Ts...>& v)
 {
-  throw std::runtime_error("deserialize(InputArchive,variant): invalid index.");
+  ar(v.template emplace<i>());
 }
 
-template<size_t i, class InputArchive, class... Ts, __REQUIRES(i < sizeof...(Ts))>
-void deserialize_variant_impl(InputArchive& ar, size_t index, variant<Ts...>& v)
+// other alternatives are constructed by deserialize_construct and moved into the variant
+template<size_t i, class InputArchive, class... Ts,
+         __REQUIRES(!std::is_default_constructible<variant_alternative_t<i, variant<Ts...>>>::value)>
+void deserialize_variant_alternative(InputArchive& ar, variant<Ts...>& v)
 {
-  if(index == i)
+  using value_type = variant_alternative_t<i, variant<Ts...>>;
+
+  v.template emplace<i>(deserialize_construct(ar, deserialize_construct_tag<value_type>()));
+}
+
+// the alternative to deserialize is selected through a table of function pointers indexed by the variant's index
+template<class InputArchive, class... Ts, size_t... is>
+void deserialize_variant_impl(InputArchive& ar, size_t index, variant<Ts...>& v, index_sequence<is...>)
+{
+  using function_ptr_type = void (*)(InputArchive&, variant<Ts...>&);
+  static constexpr function_ptr_type table[] = {&deserialize_variant_alternative<is>...};
+
+  if(index >= sizeof...(Ts))
   {
-    variant_alternative_t<i, variant<Ts...>> value;
-    ar(value);
+    throw std::runtime_error("deserialize(InputArchive,variant): invalid index.");
+  }
+
+  table[index](ar, v);
+}
 
-    v = value;
+// variants of two alternatives select with a single branch
+template<class InputArchive, class T0, class T1>
+void deserialize_variant_impl(InputArchive& ar, size_t index, variant<T0,T1>& v, index_sequence<0,1>)
+{
+  if(index == 0)
+  {
+    deserialize_variant_alternative<0>(ar, v);
+  }
+  else if(index == 1)
+  {
+    deserialize_variant_alternative<1>(ar, v);
   }
   else
   {
-    deserialize_variant_impl<i+1>(ar, index, v);
+    throw std::runtime_error("deserialize(InputArchive,variant): invalid index.");
   }
 }
 
@@ -201,7 +409,54 @@ void deserialize(InputArchive& ar, variant<Types...>& v)
   size_t index;
   ar(index);
 
-  deserialize_variant_impl<0>(ar, index, v);
+  deserialize_variant_impl(ar, index, v, make_index_sequence<sizeof...(Types)>());
+}
+
+
+template<class OutputArchive, class T>
+void serialize(OutputArchive& ar, const optional<T>& o)
+{
+  // serialize whether the value exists
+  ar(o.has_value());
+
+  // serialize the value
+  if(o)
+  {
+    ar(*o);
+  }
+}
+
+
+template<class InputArchive, class T,
+         __REQUIRES(std::is_default_constructible<T>::value)>
+void deserialize_optional_value(InputArchive& ar, optional<T>& o)
+{
+  o.emplace();
+  ar(*o);
+}
+
+template<class InputArchive, class T,
+         __REQUIRES(!std::is_default_constructible<T>::value)>
+void deserialize_optional_value(InputArchive& ar, optional<T>& o)
+{
+  o.emplace(deserialize_construct(ar, deserialize_construct_tag<T>()));
+}
+
+template<class InputArchive, class T>
+void deserialize(InputArchive& ar, optional<T>& o)
+{
+  // deserialize whether the value exists
+  bool has_value = false;
+  ar(has_value);
+
+  if(has_value)
+  {
+    deserialize_optional_value(ar, o);
+  }
+  else
+  {
+    o.reset();
+  }
 }
 
 
@@ -267,6 +522,264 @@ class input_archive
 };
 
 
+// a std::string's length is followed by a single space
+// consume only that space, because the string's own characters may begin with whitespace
+inline void deserialize(input_archive& ar, std::string& s)
+{
+  std::size_t length = 0;
+  ar.stream() >> length;
+  ar.stream().get();
+
+  s.resize(length);
+  ar.stream().read(&s.front(), length);
+}
+
+
+// compact_output_archive & compact_input_archive are binary alternatives to the archives above
+// integers are encoded as LEB128 varints, and signed integers are zigzag-encoded first so that
+// small negative numbers also encode into few bytes
+// floating point numbers and vectors of arithmetic types are stored as raw fixed-width bytes
+// types which fall back to formatted output are stored as length-prefixed text,
+// so that parsing the text never consumes the bytes which follow it
+// XXX the fixed-width encodings assume that both ends of the stream share a byte order
+class compact_output_archive
+{
+  private:
+    // this is the terminal case of operator() above
+    // it never needs to be called by a client
+    inline void operator()() {}
+
+    std::ostream& stream_;
+
+  public:
+    inline compact_output_archive(std::ostream& os)
+      : stream_(os)
+    {}
+
+    inline ~compact_output_archive()
+    {
+      stream_.flush();
+    }
+
+    template<class Arg, class... Args>
+    void operator()(const Arg& arg, const Args&... args)
+    {
+      serialize(*this, arg);
+
+      (*this)(args...);
+    }
+
+    inline std::ostream& stream()
+    {
+      return stream_;
+    }
+
+    inline void write_varint(std::uint64_t value)
+    {
+      // emit seven bits at a time, setting the high bit of each byte which is followed by another
+      char bytes[10];
+      std::size_t num_bytes = 0;
+
+      while(value >= 0x80)
+      {
+        bytes[num_bytes++] = static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+      }
+
+      bytes[num_bytes++] = static_cast<char>(value);
+
+      stream_.write(bytes, num_bytes);
+    }
+};
+
+class compact_input_archive
+{
+  public:
+    inline compact_input_archive(std::istream& is)
+      : stream_(is)
+    {}
+
+    template<class Arg, class... Args>
+    void operator()(Arg& arg, Args&... args)
+    {
+      deserialize(*this, arg);
+
+      (*this)(args...);
+    }
+
+    inline std::istream& stream()
+    {
+      return stream_;
+    }
+
+    inline std::uint64_t read_varint()
+    {
+      std::uint64_t result = 0;
+
+      for(int shift = 0; shift < 64; shift += 7)
+      {
+        std::istream::int_type byte = stream_.get();
+        if(byte == std::istream::traits_type::eof())
+        {
+          // get() has already set failbit
+          return 0;
+        }
+
+        result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+        if((byte & 0x80) == 0)
+        {
+          return result;
+        }
+      }
+
+      // the encoding is longer than any 64b integer
+      stream_.setstate(std::ios_base::failbit);
+      return 0;
+    }
+
+  private:
+    // this is the terminal case of operator() above
+    // it never needs to be called by a client
+    inline void operator()() {}
+
+    std::istream& stream_;
+};
+
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(sizeof(T) == 1)>
+void serialize(compact_output_archive& ar, const T& value)
+{
+  // bools and chars are a single byte already
+  ar.stream().put(static_cast<char>(value));
+}
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(std::is_unsigned<T>::value),
+         __REQUIRES(sizeof(T) > 1)>
+void serialize(compact_output_archive& ar, const T& value)
+{
+  ar.write_varint(value);
+}
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(std::is_signed<T>::value),
+         __REQUIRES(sizeof(T) > 1)>
+void serialize(compact_output_archive& ar, const T& value)
+{
+  // zigzag encoding maps 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+  std::int64_t signed_value = value;
+  ar.write_varint((static_cast<std::uint64_t>(signed_value) << 1) ^ static_cast<std::uint64_t>(signed_value >> 63));
+}
+
+template<class T,
+         __REQUIRES(std::is_floating_point<T>::value)>
+void serialize(compact_output_archive& ar, const T& value)
+{
+  ar.stream().write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T,
+         __REQUIRES(!std::is_function<T>::value)>
+void serialize(compact_output_archive& ar, T* const& ptr)
+{
+  ar.write_varint(reinterpret_cast<std::uintptr_t>(ptr));
+}
+
+template<class T,
+         __REQUIRES(std::is_arithmetic<T>::value),
+         __REQUIRES(!std::is_same<T,bool>::value)>
+void serialize(compact_output_archive& ar, const std::vector<T>& vector)
+{
+  // output the length
+  ar.write_varint(vector.size());
+
+  // output the elements in bulk
+  write_contiguous(ar.stream(), reinterpret_cast<const char*>(vector.data()), vector.size() * sizeof(T));
+}
+
+template<class T>
+void serialize_formatted(compact_output_archive& ar, const T& value)
+{
+  string_ostream os;
+  os << value;
+
+  serialize(ar, os.str());
+}
+
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(sizeof(T) == 1)>
+void deserialize(compact_input_archive& ar, T& value)
+{
+  value = static_cast<T>(ar.stream().get());
+}
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(std::is_unsigned<T>::value),
+         __REQUIRES(sizeof(T) > 1)>
+void deserialize(compact_input_archive& ar, T& value)
+{
+  value = static_cast<T>(ar.read_varint());
+}
+
+template<class T,
+         __REQUIRES(std::is_integral<T>::value),
+         __REQUIRES(std::is_signed<T>::value),
+         __REQUIRES(sizeof(T) > 1)>
+void deserialize(compact_input_archive& ar, T& value)
+{
+  // undo the zigzag encoding
+  std::uint64_t encoded = ar.read_varint();
+  value = static_cast<T>(static_cast<std::int64_t>((encoded >> 1) ^ (~(encoded & 1) + 1)));
+}
+
+template<class T,
+         __REQUIRES(std::is_floating_point<T>::value)>
+void deserialize(compact_input_archive& ar, T& value)
+{
+  ar.stream().read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+inline void deserialize(compact_input_archive& ar, void*& ptr)
+{
+  ptr = reinterpret_cast<void*>(static_cast<std::uintptr_t>(ar.read_varint()));
+}
+
+template<class T,
+         __REQUIRES(std::is_arithmetic<T>::value),
+         __REQUIRES(!std::is_same<T,bool>::value)>
+void deserialize(compact_input_archive& ar, std::vector<T>& vector)
+{
+  // read the length and resize the vector
+  vector.resize(ar.read_varint());
+
+  // read the elements in bulk
+  ar.stream().read(reinterpret_cast<char*>(vector.data()), vector.size() * sizeof(T));
+}
+
+template<class T>
+void deserialize_formatted(compact_input_archive& ar, T& value)
+{
+  std::string text;
+  deserialize(ar, text);
+
+  string_view_stream is(text.data(), text.size());
+  is >> value;
+
+  if(is.fail())
+  {
+    ar.stream().setstate(std::ios_base::failbit);
+  }
+}
+
+
 class any;
 
 template<class ValueType>
@@ -281,7 +794,7 @@ class any
     template<class T>
     any(T&& value)
     {
-      std::stringstream os;
+      string_ostream os;
 
       {
         output_archive archive(os);
@@ -289,7 +802,7 @@ class any
         archive(value);
       }
 
-      representation_ = os.str();
+      representation_ = os.release();
     }
 
     template<class ValueType>
@@ -297,7 +810,7 @@ class any
     {
       ValueType result;
 
-      std::stringstream is(self.representation_);
+      string_view_stream is(self.representation_.data(), self.representation_.size());
       input_archive archive(is);
 
       archive(result);
@@ -381,6 +894,55 @@ template<class... Ts>
 using can_deserialize_all = conjunction<can_deserialize<Ts>...>;
 
 
+template<class... Ts>
+struct sum_of_sizes;
+
+template<>
+struct sum_of_sizes<> : std::integral_constant<std::size_t, 0> {};
+
+template<class T, class... Ts>
+struct sum_of_sizes<T,Ts...> : std::integral_constant<std::size_t, sizeof(T) + sum_of_sizes<Ts...>::value> {};
+
+
+// a type is bitwise serializable when it is trivially copyable and its listed members are arithmetic or enumerations
+// which fill it exactly, so that its bytes are its members and nothing else
+template<class T, class... Members>
+using is_bitwise_serializable = std::integral_constant<
+  bool,
+  std::is_trivially_copyable<T>::value &&
+  conjunction<std::integral_constant<bool, std::is_arithmetic<Members>::value || std::is_enum<Members>::value>...>::value &&
+  sum_of_sizes<Members...>::value == sizeof(T)
+>;
+
+
+// serialize_member_list and deserialize_member_list implement the functions defined by SERIALIZABLE_MEMBERS
+template<class OutputArchive, class T, class... Members>
+void serialize_member_list(OutputArchive& ar, const T&, const Members&... members)
+{
+  ar(members...);
+}
+
+template<class T, class... Members,
+         __REQUIRES(is_bitwise_serializable<T,Members...>::value)>
+void serialize_member_list(compact_output_archive& ar, const T& self, const Members&...)
+{
+  ar.stream().write(reinterpret_cast<const char*>(&self), sizeof(T));
+}
+
+template<class InputArchive, class T, class... Members>
+void deserialize_member_list(InputArchive& ar, T&, Members&... members)
+{
+  ar(members...);
+}
+
+template<class T, class... Members,
+         __REQUIRES(is_bitwise_serializable<T,Members...>::value)>
+void deserialize_member_list(compact_input_archive& ar, T& self, Members&...)
+{
+  ar.stream().read(reinterpret_cast<char*>(&self), sizeof(T));
+}
+
+
 
 class serializable_closure
 {
@@ -392,18 +954,26 @@ class serializable_closure
       : serializable_closure(&noop_function)
     {}
 
+    // the function and arguments are only read while they are serialized, so they are taken by forwarding reference
+    // rather than copied
+    // a lone serializable_closure argument selects the copy or move constructor instead of this one
     template<class Function, class... Args,
-             __REQUIRES(can_serialize_all<Function,Args...>::value),
-             __REQUIRES(can_deserialize_all<Function,Args...>::value),
-             __REQUIRES(is_invocable<Function,Args...>::value)
+             __REQUIRES(sizeof...(Args) > 0 || !std::is_same<typename std::decay<Function>::type, serializable_closure>::value),
+             __REQUIRES(can_serialize_all<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value),
+             __REQUIRES(can_deserialize_all<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value),
+             __REQUIRES(is_invocable<typename std::decay<Function>::type, typename std::decay<Args>::type...>::value)
             >
-    explicit serializable_closure(Function func, Args... args)
-      : serialized_(serialize_function_and_arguments(&deserialize_and_invoke<Function,Args...>, func, args...))
+    explicit serializable_closure(Function&& func, Args&&... args)
+      : serialized_(serialize_function_and_arguments(
+          &deserialize_and_invoke<typename std::decay<Function>::type, typename std::decay<Args>::type...>,
+          func,
+          args...
+        ))
     {}
 
     any operator()() const
     {
-      std::stringstream is(serialized_);
+      string_view_stream is(serialized_.data(), serialized_.size());
       input_archive archive(is);
 
       // extract a function_ptr_type from the beginning of the buffer
@@ -454,17 +1024,17 @@ class serializable_closure
       std::tuple<FunctionPtr,Args...> function_and_args;
       archive(function_and_args);
 
-      // split tuple into a function pointer and arguments
-      FunctionPtr f = std::get<0>(function_and_args);
-      std::tuple<Args...> arguments = tail(function_and_args);
+      // move the arguments into the function through a view of the tuple's tail,
+      // rather than copying them into a new tuple
+      FunctionPtr f = std::move(std::get<0>(function_and_args));
 
-      return apply_and_return_any(f, arguments);
+      return apply_and_return_any(std::move(f), tail_view(std::move(function_and_args)));
     }
 
     template<class... Args>
     static std::string serialize_function_and_arguments(const Args&... args)
     {
-      std::stringstream os;
+      string_ostream os;
 
       {
         output_archive archive(os);
@@ -473,7 +1043,7 @@ class serializable_closure
         archive(args...);
       }
 
-      return os.str();
+      return os.release();
     }
 
     std::string serialized_;
@@ -483,10 +1053,14 @@ class serializable_closure
 template<class T>
 std::string to_string(const T& value)
 {
-  std::stringstream os;
-  output_archive ar(os);
-  ar(value);
-  return os.str();
+  string_ostream os;
+
+  {
+    output_archive ar(os);
+    ar(value);
+  }
+
+  return os.release();
 }
 
 
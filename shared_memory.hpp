@@ -0,0 +1,210 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "frame.hpp"
+
+
+// results which are delivered to a process on the same machine may bypass the socket entirely:
+// the sender writes the payload into an anonymous memory file, and passes its file descriptor
+// alongside a frame header through an AF_UNIX socket (SCM_RIGHTS)
+// the receiver maps the file and deserializes directly from the mapping
+
+
+// payloads at least this large are sent through shared memory when the receiver is on the same machine
+// the threshold may be set through the environment variable SHMEM_EXECUTOR_SHARED_MEMORY_THRESHOLD
+inline std::size_t default_shared_memory_threshold()
+{
+  static const std::size_t result = []
+  {
+    const char* variable = std::getenv("SHMEM_EXECUTOR_SHARED_MEMORY_THRESHOLD");
+    return variable ? static_cast<std::size_t>(std::strtoull(variable, nullptr, 10)) : std::size_t(1 << 20);
+  }();
+
+  return result;
+}
+
+
+// returns true if file descriptors can be passed through the given file descriptor
+inline bool is_local_socket(int fd)
+{
+  sockaddr_storage address{};
+  socklen_t address_length = sizeof(address);
+
+  return getsockname(fd, reinterpret_cast<sockaddr*>(&address), &address_length) == 0 && address.ss_family == AF_UNIX;
+}
+
+
+// creates an anonymous file holding the given segments in order and returns its file descriptor
+inline int make_shared_memory(const std::vector<iovec>& segments)
+{
+  int fd = memfd_create("shmem_executor_frame", MFD_CLOEXEC);
+  if(fd == -1)
+  {
+    throw std::system_error(errno, std::system_category(), "make_shared_memory(): Error after memfd_create()");
+  }
+
+  try
+  {
+    write_segments(fd, segments);
+  }
+  catch(...)
+  {
+    ::close(fd);
+    throw;
+  }
+
+  return fd;
+}
+
+
+// sends a frame whose payload is held in shared memory through a local socket
+inline void send_shared_memory_frame(int socket, const gather_ostream& payload, std::uint64_t type_hash = 0)
+{
+  int shared_memory = make_shared_memory(payload.segments());
+
+  string_ostream header_stream;
+  write_frame_header(header_stream, frame_header(frame_shared_memory, payload.size(), 0, type_hash));
+  std::string header = header_stream.release();
+
+  iovec data{&header[0], header.size()};
+
+  // the file descriptor accompanies the first byte of the header
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+  msghdr message{};
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+  control_message->cmsg_level = SOL_SOCKET;
+  control_message->cmsg_type = SCM_RIGHTS;
+  control_message->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(control_message), &shared_memory, sizeof(int));
+
+  ssize_t num_sent = 0;
+  while((num_sent = sendmsg(socket, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+
+  int error = errno;
+
+  // the receiver holds its own reference to the file after sendmsg()
+  ::close(shared_memory);
+
+  if(num_sent == -1)
+  {
+    throw std::system_error(error, std::system_category(), "send_shared_memory_frame(): Error after sendmsg()");
+  }
+
+  // send whatever remains of the header without the file descriptor
+  for(std::size_t i = num_sent; i < header.size(); )
+  {
+    ssize_t n = ::write(socket, header.data() + i, header.size() - i);
+    if(n == -1)
+    {
+      if(errno == EINTR) continue;
+      throw std::system_error(errno, std::system_category(), "send_shared_memory_frame(): Error after write()");
+    }
+
+    i += n;
+  }
+}
+
+
+// maps a shared memory segment received through a frame, and closes the segment's file descriptor
+class shared_memory_mapping
+{
+  public:
+    shared_memory_mapping(int fd, std::size_t size)
+      : data_(nullptr), size_(size)
+    {
+      // ensure the segment holds the whole payload, so that reading the mapping cannot fault
+      struct stat status;
+      if(fstat(fd, &status) == -1 || static_cast<std::size_t>(status.st_size) < size)
+      {
+        ::close(fd);
+        throw std::system_error(EINVAL, std::system_category(), "shared_memory_mapping ctor: Segment is smaller than its frame");
+      }
+
+      if(size > 0)
+      {
+        void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if(ptr == MAP_FAILED)
+        {
+          int error = errno;
+          ::close(fd);
+          throw std::system_error(error, std::system_category(), "shared_memory_mapping ctor: Error after mmap()");
+        }
+
+        data_ = static_cast<const char*>(ptr);
+      }
+
+      // the mapping keeps the segment alive
+      ::close(fd);
+    }
+
+    shared_memory_mapping(const shared_memory_mapping&) = delete;
+
+    ~shared_memory_mapping()
+    {
+      if(data_)
+      {
+        munmap(const_cast<char*>(data_), size_);
+      }
+    }
+
+    const char* data() const
+    {
+      return data_;
+    }
+
+    std::size_t size() const
+    {
+      return size_;
+    }
+
+  private:
+    const char* data_;
+    std::size_t size_;
+};
+
@@ -28,11 +28,21 @@
 
 #include <shmem.h>
 
+#include <array>
+#include <thread>
+#include <exception>
+#include <utility>
+#include <vector>
+
 #include "new_process_executor.hpp"
+#include "active_message_queue.hpp"
 #include "remote_ptr.hpp"
 #include "uninitialized.hpp"
 #include "interprocess_future.hpp"
+#include "interprocess_channel.hpp"
 #include "socket.hpp"
+#include "team.hpp"
+#include "trace.hpp"
 
 class shmem_executor
 {
@@ -42,6 +52,7 @@ class shmem_executor
     {
       mutable Function f;
       mutable SharedFactory shared_factory;
+      bool multithreaded;
 
       // XXX in C++17, this would just be a variable template
       template<class T>
@@ -59,7 +70,10 @@ class shmem_executor
       template<class T, __REQUIRES(!std::is_trivially_destructible<T>::value)>
       static void synchronize_and_destroy_shared_parameter_if(int rank)
       {
-        shmem_barrier_all();
+        {
+          __TRACE_SPAN("barrier");
+          shmem_barrier_all();
+        }
 
         if(rank == 0)
         {
@@ -67,10 +81,27 @@ class shmem_executor
         }
       }
 
+      // shmem_init_thread() first appeared in OpenSHMEM 1.4
+      static void initialize_shmem(bool multithreaded)
+      {
+#if (SHMEM_MAJOR_VERSION > 1) || (SHMEM_MAJOR_VERSION == 1 && SHMEM_MINOR_VERSION >= 4)
+        if(multithreaded)
+        {
+          int provided = SHMEM_THREAD_SINGLE;
+          shmem_init_thread(SHMEM_THREAD_MULTIPLE, &provided);
+          return;
+        }
+#endif
+        shmem_init();
+      }
+
       void operator()() const
       {
         // construct OpenSHMEM
-        shmem_init();
+        {
+          __TRACE_SPAN("shmem_init");
+          initialize_shmem(multithreaded);
+        }
 
         // compute the type of the shared parameter
         using shared_parameter_type = typename std::result_of<SharedFactory()>::type;
@@ -78,9 +109,13 @@ class shmem_executor
         // get this processing element's rank
         int rank = shmem_my_pe();
 
+        trace::set_process_name("PE " + std::to_string(rank));
+
         // rank 0 initializes the shared parameter as an OpenSHMEM "symmetric" object
         if(rank == 0)
         {
+          __TRACE_SPAN("shared_parameter_construction");
+
           // note that there is only one of these "symmetric" objects per-type, per-process
           // however, since shmem_executor spawns a process for each agent it creates,
           // this is safe
@@ -90,45 +125,298 @@ class shmem_executor
         }
 
         // all processing elements wait for the shared_parameter to be constructed
-        shmem_barrier_all();
+        {
+          __TRACE_SPAN("barrier");
+          shmem_barrier_all();
+        }
 
         // point at PE 0's instance of shared_parameter
         remote_ptr<shared_parameter_type> remote_shared_parameter(&shared_parameter<shared_parameter_type>::value.get(), 0);
 
         // invoke f, passing a remote_reference to the shared parameter
-        f(rank, *remote_shared_parameter);
+        {
+          __TRACE_SPAN("user_function");
+          f(rank, *remote_shared_parameter);
+        }
 
         // synchronize with a barrier and destroy the shared parameter if it has a non-trivial destructor
         synchronize_and_destroy_shared_parameter_if<shared_parameter_type>(rank);
 
         // destroy OpenSHMEM
-        shmem_finalize();
+        {
+          __TRACE_SPAN("shmem_finalize");
+          shmem_finalize();
+        }
+      }
+
+      SERIALIZABLE_MEMBERS(f, shared_factory, multithreaded);
+    };
+
+    // launches n processing elements which each execute f
+    template<class Function>
+    static void launch(Function&& f, size_t n)
+    {
+      std::string n_as_string = std::to_string(n);
+      std::array<const char*, 4> argv = {"oshrun", "-n", n_as_string.c_str(), nullptr};
+      new_process_executor exec(argv[0], argv);
+
+      exec.execute(std::forward<Function>(f));
+    }
+
+    template<class Function, class SharedFactory>
+    void bulk_execute_impl(Function f, size_t n, SharedFactory shared_factory, bool multithreaded) const
+    {
+      launch(bulk_oneway_functor<Function, SharedFactory>{f, shared_factory, multithreaded}, n);
+    }
+
+  public:
+    template<class Function, class SharedFactory>
+    void bulk_execute(Function f, size_t n, SharedFactory shared_factory) const
+    {
+      bulk_execute_impl(f, n, shared_factory, false);
+    }
+
+    using prepared_job = new_process_executor::prepared_job;
+
+    // serializes f and shared_factory once, so that repeated launches through bulk_execute(const prepared_job&, n)
+    // skip serialization and the construction of the spawned processes' environment
+    template<class Function, class SharedFactory>
+    prepared_job prepare_bulk_execute(Function f, SharedFactory shared_factory) const
+    {
+      return global_process_context.prepare(bulk_oneway_functor<Function, SharedFactory>{f, shared_factory, false});
+    }
+
+    void bulk_execute(const prepared_job& job, size_t n) const
+    {
+      launch(job, n);
+    }
+
+    // removes job's file once the processes executing it have exited; job must not be executed again
+    void release(const prepared_job& job) const
+    {
+      global_process_context.release(job);
+    }
+
+  private:
+    // thread_team_functor adapts a function receiving a two-dimensional index to bulk_oneway_functor
+    // each processing element starts a team of threads, and each thread invokes the function with
+    // the index (processing element rank, thread rank)
+    template<class Function>
+    struct thread_team_functor
+    {
+      mutable Function f;
+      size_t threads_per_processing_element;
+
+      template<class SharedReference>
+      void operator()(size_t rank, SharedReference shared_parameter) const
+      {
+        int provided = SHMEM_THREAD_SINGLE;
+#if (SHMEM_MAJOR_VERSION > 1) || (SHMEM_MAJOR_VERSION == 1 && SHMEM_MINOR_VERSION >= 4)
+        shmem_query_thread(&provided);
+#endif
+
+        if(provided != SHMEM_THREAD_MULTIPLE)
+        {
+          // without SHMEM_THREAD_MULTIPLE, only one thread may call into OpenSHMEM at a time,
+          // so the team's agents execute one after another on this thread
+          for(size_t thread_rank = 0; thread_rank < threads_per_processing_element; ++thread_rank)
+          {
+            f(std::make_pair(rank, thread_rank), shared_parameter);
+          }
+
+          return;
+        }
+
+        // each thread reports its exception, if any, into its own slot
+        std::vector<std::exception_ptr> exceptions(threads_per_processing_element);
+
+        std::vector<std::thread> team;
+        team.reserve(threads_per_processing_element - 1);
+
+        // the calling thread participates as thread 0, so create one fewer thread
+        for(size_t thread_rank = 1; thread_rank < threads_per_processing_element; ++thread_rank)
+        {
+          team.emplace_back([&,thread_rank]
+          {
+            try
+            {
+              f(std::make_pair(rank, thread_rank), shared_parameter);
+            }
+            catch(...)
+            {
+              exceptions[thread_rank] = std::current_exception();
+            }
+          });
+        }
+
+        try
+        {
+          f(std::make_pair(rank, size_t(0)), shared_parameter);
+        }
+        catch(...)
+        {
+          exceptions[0] = std::current_exception();
+        }
+
+        for(std::thread& thread : team)
+        {
+          thread.join();
+        }
+
+        // rethrow the first exception encountered
+        for(const std::exception_ptr& e : exceptions)
+        {
+          if(e)
+          {
+            std::rethrow_exception(e);
+          }
+        }
+      }
+
+      SERIALIZABLE_MEMBERS(f, threads_per_processing_element);
+    };
+
+  public:
+    // creates shape.first processing elements, each of which starts a team of shape.second threads
+    // each thread invokes f(std::make_pair(processing_element_rank, thread_rank), shared_parameter)
+    // threads within a processing element share its address space, so only agents on different
+    // processing elements need communicate through OpenSHMEM
+    template<class Function, class SharedFactory>
+    void bulk_execute(Function f, std::pair<size_t,size_t> shape, SharedFactory shared_factory) const
+    {
+      if(shape.second == 0)
+      {
+        throw std::invalid_argument("shmem_executor::bulk_execute(): threads per processing element must be positive.");
+      }
+
+      bulk_execute_impl(thread_team_functor<Function>{f, shape.second}, shape.first, shared_factory, true);
+    }
+
+  private:
+    // work_stealing_functor adapts a function over a large logical index space to bulk_oneway_functor,
+    // which creates one agent per processing element
+    // the index space is divided into chunks of grain_size indices, and each processing element owns
+    // a deque of chunks. processing elements first execute their own chunks and then steal chunks from others
+    template<class Function>
+    struct work_stealing_functor
+    {
+      mutable Function f;
+      size_t n;
+      size_t grain_size;
+
+      // each processing element's deque is a contiguous range of chunk indices [first, last)
+      // both ends are packed into a single symmetric word so that the deque can be updated by a single compare-and-swap
+      static long long symmetric_deque;
+
+      static long long pack(size_t first, size_t last)
+      {
+        return static_cast<long long>((static_cast<unsigned long long>(first) << 32) | static_cast<unsigned long long>(last));
+      }
+
+      static size_t first(long long deque)
+      {
+        return static_cast<unsigned long long>(deque) >> 32;
+      }
+
+      static size_t last(long long deque)
+      {
+        return static_cast<unsigned long long>(deque) & 0xffffffffull;
+      }
+
+      // attempts to claim a chunk from processing_element's deque
+      // the owner of a deque claims chunks from its front, while thieves claim chunks from its back
+      static bool try_pop(int processing_element, bool from_front, size_t& chunk)
+      {
+        long long expected = shmem_longlong_atomic_fetch(&symmetric_deque, processing_element);
+
+        while(first(expected) < last(expected))
+        {
+          long long desired = from_front ?
+            pack(first(expected) + 1, last(expected)) :
+            pack(first(expected), last(expected) - 1);
+
+          long long observed = shmem_longlong_atomic_compare_swap(&symmetric_deque, expected, desired, processing_element);
+          if(observed == expected)
+          {
+            chunk = from_front ? first(expected) : last(expected) - 1;
+            return true;
+          }
+
+          expected = observed;
+        }
+
+        return false;
       }
 
-      template<class OutputArchive>
-      friend void serialize(OutputArchive& ar, const bulk_oneway_functor& self)
+      template<class SharedReference>
+      void execute_chunk(size_t chunk, SharedReference& shared_parameter) const
       {
-        ar(self.f);
-        ar(self.shared_factory);
+        size_t begin = chunk * grain_size;
+        size_t end = std::min(begin + grain_size, n);
+
+        for(size_t idx = begin; idx < end; ++idx)
+        {
+          f(idx, shared_parameter);
+        }
       }
 
-      template<class InputArchive>
-      friend void deserialize(InputArchive& ar, bulk_oneway_functor& self)
+      template<class SharedReference>
+      void operator()(size_t rank, SharedReference shared_parameter) const
       {
-        ar(self.f);
-        ar(self.shared_factory);
+        int num_processing_elements = shmem_n_pes();
+        size_t num_chunks = (n + grain_size - 1) / grain_size;
+
+        // initially, distribute chunks evenly across processing elements
+        symmetric_deque = pack((rank * num_chunks) / num_processing_elements, ((rank + 1) * num_chunks) / num_processing_elements);
+
+        // wait for every deque to be initialized before anyone steals
+        shmem_barrier_all();
+
+        size_t chunk = 0;
+
+        // drain our own deque
+        while(try_pop(rank, true, chunk))
+        {
+          execute_chunk(chunk, shared_parameter);
+        }
+
+        // steal from every other processing element in turn
+        // since chunks are never added to a deque, a deque found empty stays empty, so a single pass suffices
+        for(int i = 1; i < num_processing_elements; ++i)
+        {
+          int victim = (rank + i) % num_processing_elements;
+
+          while(try_pop(victim, false, chunk))
+          {
+            execute_chunk(chunk, shared_parameter);
+          }
+        }
       }
+
+      SERIALIZABLE_MEMBERS(f, n, grain_size);
     };
 
   public:
+    // executes f(idx, shared_parameter) for each idx in [0, n) using num_processing_elements processing elements
+    // unlike bulk_execute, n may be much larger than the number of processing elements
+    // idle processing elements balance the load by stealing chunks of grain_size indices from busy processing elements
+    // XXX stealing relies on remote atomics which complete without the victim's participation. some OpenSHMEM
+    //     implementations only service atomics when the target calls into the library, which defeats stealing
     template<class Function, class SharedFactory>
-    void bulk_execute(Function f, size_t n, SharedFactory shared_factory) const
+    void work_stealing_bulk_execute(Function f, size_t n, SharedFactory shared_factory, size_t num_processing_elements, size_t grain_size = 1) const
     {
-      std::string n_as_string = std::to_string(n);
-      std::array<const char*, 4> argv = {"oshrun", "-n", n_as_string.c_str(), nullptr};
-      new_process_executor exec(argv[0], argv);
+      if(grain_size == 0)
+      {
+        throw std::invalid_argument("shmem_executor::work_stealing_bulk_execute(): grain_size must be positive.");
+      }
+
+      // chunk indices are packed into 32b halves of a single word
+      if((n + grain_size - 1) / grain_size > 0xffffffffull)
+      {
+        throw std::length_error("shmem_executor::work_stealing_bulk_execute(): Too many chunks; increase grain_size.");
+      }
 
-      exec.execute(bulk_oneway_functor<Function, SharedFactory>{f, shared_factory});
+      this->bulk_execute(work_stealing_functor<Function>{f, n, grain_size}, num_processing_elements, shared_factory);
     }
 
   private:
@@ -146,28 +434,92 @@ class shmem_executor
         return std::make_pair(factory1(), factory2());
       }
 
-      template<class OutputArchive>
-      friend void serialize(OutputArchive& ar, const pair_factory& self)
-      {
-        ar(self.factory1, self.factory2);
-      }
-
-      template<class InputArchive>
-      friend void deserialize(InputArchive& ar, pair_factory& self)
-      {
-        ar(self.factory1, self.factory2);
-      }
+      SERIALIZABLE_MEMBERS(factory1, factory2);
     };
 
     // twoway_bulk_execute_functor is the functor used in twoway_bulk_execute
     // which adapts bulk_execute's one-way behavior to implement twoway_bulk_execute's
     // twoway behavior
-    template<class Result, class Shared, class Function>
+    // when CountRemoteMemoryTraffic is true, the functor counts the remote memory traffic generated by each agent,
+    // and the promise is fulfilled with a std::pair containing the result and the job's total counters
+    template<class Result, class Shared, class Function, bool CountRemoteMemoryTraffic = false>
     struct twoway_bulk_execute_functor
     {
       mutable Function user_function;
-      std::string hostname;
-      int port;
+      endpoint host;
+
+      using promised_type = typename std::conditional<
+        CountRemoteMemoryTraffic,
+        std::pair<Result,remote_memory_counters>,
+        Result
+      >::type;
+
+      static const Result& promised_value(const Result& result, const remote_memory_counters&, std::false_type)
+      {
+        return result;
+      }
+
+      static std::pair<Result,remote_memory_counters> promised_value(const Result& result, const remote_memory_counters& counters, std::true_type)
+      {
+        return std::make_pair(result, counters);
+      }
+
+      static void reduce_counters(remote_memory_counters&, std::false_type)
+      {
+        // no-op
+      }
+
+      // sums every agent's counters into processing element 0's counters
+      // this function is collective
+      static void reduce_counters(remote_memory_counters& counters, std::true_type)
+      {
+        size_t num_processing_elements = shmem_n_pes();
+
+        // the first four elements hold the scalar counters and the remainder hold the histogram
+        size_t num_totals = 4 + num_processing_elements;
+        size_t num_work_elements = std::max<size_t>(num_totals / 2 + 1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+
+        // the reduction's source, destination, and work arrays are symmetric
+        long long* symmetric_counters = static_cast<long long*>(shmem_malloc((2 * num_totals + num_work_elements) * sizeof(long long)));
+        long* symmetric_sync = static_cast<long*>(shmem_malloc(SHMEM_REDUCE_SYNC_SIZE * sizeof(long)));
+        if(symmetric_counters == nullptr || symmetric_sync == nullptr)
+        {
+          shmem_free(symmetric_counters);
+          shmem_free(symmetric_sync);
+          throw std::bad_alloc();
+        }
+
+        long long* source = symmetric_counters;
+        long long* totals = source + num_totals;
+        long long* work = totals + num_totals;
+
+        source[0] = counters.num_gets();
+        source[1] = counters.num_puts();
+        source[2] = counters.bytes_gotten();
+        source[3] = counters.bytes_put();
+
+        const std::vector<size_t>& histogram = counters.accesses_per_processing_element();
+        for(size_t i = 0; i < num_processing_elements; ++i)
+        {
+          source[4 + i] = i < histogram.size() ? histogram[i] : 0;
+        }
+
+        std::fill(symmetric_sync, symmetric_sync + SHMEM_REDUCE_SYNC_SIZE, SHMEM_SYNC_VALUE);
+
+        // ensure every processing element's sync array is initialized before the reduction begins
+        shmem_barrier_all();
+
+        shmem_longlong_sum_to_all(totals, source, num_totals, 0, 0, num_processing_elements, work, symmetric_sync);
+
+        if(shmem_my_pe() == 0)
+        {
+          counters = remote_memory_counters(totals[0], totals[1], totals[2], totals[3],
+                                            std::vector<size_t>(totals + 4, totals + num_totals));
+        }
+
+        shmem_free(symmetric_sync);
+        shmem_free(symmetric_counters);
+      }
 
       // this function implements a cooperative logical or reduction
       // each agent contributes a value as a parameter, and this function
@@ -175,35 +527,15 @@ class shmem_executor
       // this function implicitly introduces a barrier as a side effect of
       static bool cooperative_any(bool value)
       {
-        // assign our value to a symmetric (i.e., static) value
-        static int symmetric_value = value;
-
-        // this (symmetric) variable will store the result
-        static int symmetric_result;
-
-        // scratch space for the reduction
-        static std::array<int,  SHMEM_REDUCE_MIN_WRKDATA_SIZE> symmetric_work_array1;
-        static std::array<long, SHMEM_REDUCE_SYNC_SIZE>        symmetric_work_array2;
+        __TRACE_SPAN("cooperative_any");
 
-        // the second work_array needs to be initialized to this particular value
-        // XXX see if we can eliminate this by initializing this before anything else happens
-        //     the call to shmem_int_or_to_all() below will restore this array's value
-        symmetric_work_array2.fill(SHMEM_SYNC_VALUE);
-
-        // wait for work_array2 to fill
-        shmem_barrier_all();
+        // reduce over a tree of agents rather than through a global barrier
+        int result = team::world().reduce(static_cast<int>(value), [](int a, int b)
+        {
+          return a | b;
+        });
 
-        // execute the reduction
-        shmem_int_or_to_all(&symmetric_result,             // dest: where the result will be stored
-                            &symmetric_value,              // source: this processing element's contribution
-                            1,                             // nreduce: number of reductions to perform (there is only one)
-                            0,                             // PE_start: the first agent of the group to include in the reduction
-                            0,                             // logPE_stride: 0 => include each contiguous agent beginning at PE_start
-                            shmem_n_pes(),                 // PE_size: the number of agents to include in the reduction (shmem_n_pes() => include all of them)
-                            symmetric_work_array1.data(),  // pWork: symmetric work array (scratch space)
-                            symmetric_work_array2.data()); // pSync: symmetric work array (more scratch space)
-
-        return static_cast<bool>(symmetric_result);
+        return static_cast<bool>(result);
       }
 
       void operator()(size_t rank, remote_reference<std::pair<Result,Shared>> result_and_shared) const
@@ -222,6 +554,12 @@ class shmem_executor
 
         bool caught_exception = 0;
 
+        remote_memory_counters counters(shmem_n_pes());
+        if(CountRemoteMemoryTraffic)
+        {
+          remote_memory_accessor::count_into(&counters);
+        }
+
         // call the user function with the result & shared paramteter passed as remote_references
         try
         {
@@ -234,17 +572,24 @@ class shmem_executor
           caught_exception = 1;
         }
 
+        remote_memory_accessor::count_into(nullptr);
+
         // synchronize and discover whether any agent caught an exception
         bool some_process_caught_exception = cooperative_any(caught_exception);
 
+        // total the job's counters on rank 0
+        reduce_counters(counters, std::integral_constant<bool,CountRemoteMemoryTraffic>());
+
         // rank 0 fulfills the promise
         if(rank == 0)
         {
-          write_socket writer(hostname.c_str(), port);
+          write_socket writer = connect(host);
+
+          __TRACE_SPAN("promise_write");
 
           file_descriptor_ostream os(writer.get());
 
-          interprocess_promise<Result> promise(os);
+          interprocess_promise<promised_type> promise(os);
 
           if(some_process_caught_exception)
           {
@@ -253,46 +598,96 @@ class shmem_executor
           }
           else
           {
-            promise.set_value(*remote_result);
+            promise.set_value(promised_value(*remote_result, counters, std::integral_constant<bool,CountRemoteMemoryTraffic>()));
           }
         }
       }
 
-      template<class OutputArchive>
-      friend void serialize(OutputArchive& ar, const twoway_bulk_execute_functor& self)
+      static write_socket connect(const endpoint& host)
       {
-        ar(self.user_function, self.hostname, self.port);
+        __TRACE_SPAN("socket_connect");
+        return write_socket(host);
       }
 
-      template<class InputArchive>
-      friend void deserialize(InputArchive& ar, twoway_bulk_execute_functor& self)
-      {
-        ar(self.user_function, self.hostname, self.port);
-      }
+      SERIALIZABLE_MEMBERS(user_function, host);
     };
 
+    template<bool CountRemoteMemoryTraffic, class Function, class ResultFactory, class SharedFactory,
+             class Result = typename std::result_of<ResultFactory()>::type,
+             class Shared = typename std::result_of<SharedFactory()>::type,
+             class Functor = twoway_bulk_execute_functor<Result,Shared,Function,CountRemoteMemoryTraffic>
+            >
+    interprocess_future<typename Functor::promised_type>
+      twoway_bulk_execute_impl(Function f, size_t n, ResultFactory result_factory, SharedFactory shared_factory) const
+    {
+      // listen before creating the agents so that rank 0's connection is not refused
+      acceptor host;
+
+      // execute start the client process using the one-way function
+      this->bulk_execute(Functor{f, host.endpoint()}, n, pair_factory<ResultFactory,SharedFactory>{result_factory, shared_factory});
+
+      // create a future corresponding to the client
+      // the future accepts rank 0's connection when it is first waited on
+      return interprocess_future<typename Functor::promised_type>{std::move(host)};
+    }
+
   public:
     template<class Function, class ResultFactory, class SharedFactory>
     interprocess_future<typename std::result_of<ResultFactory()>::type>
     twoway_bulk_execute(Function f, size_t n, ResultFactory result_factory, SharedFactory shared_factory) const
     {
-      // get the name of this machine
-      char hostname[HOST_NAME_MAX];
-      if(gethostname(hostname, sizeof(hostname)) == -1)
+      return twoway_bulk_execute_impl<false>(f, n, result_factory, shared_factory);
+    }
+
+    // like twoway_bulk_execute, but also counts the remote memory traffic generated through each agent's remote_references
+    // the future's value is a std::pair containing the result and the counters totaled over all agents
+    template<class Function, class ResultFactory, class SharedFactory>
+    interprocess_future<std::pair<typename std::result_of<ResultFactory()>::type, remote_memory_counters>>
+    twoway_bulk_execute_and_count(Function f, size_t n, ResultFactory result_factory, SharedFactory shared_factory) const
+    {
+      return twoway_bulk_execute_impl<true>(f, n, result_factory, shared_factory);
+    }
+
+  private:
+    // streaming_bulk_execute_functor is the functor used in streaming_bulk_execute
+    // each agent connects to the host and passes the user function an interprocess_channel_writer
+    // through which it streams values to the host
+    template<class T, class Function>
+    struct streaming_bulk_execute_functor
+    {
+      mutable Function user_function;
+      endpoint host;
+
+      template<class SharedReference>
+      void operator()(size_t rank, SharedReference shared_parameter) const
       {
-        throw std::system_error(errno, std::system_category(), "shmem_executor::twoway_bulk_execute(): Error after gethostname()");
+        write_socket writer(host);
+
+        interprocess_channel_writer<T> channel(writer.get());
+
+        user_function(rank, channel, shared_parameter);
+
+        // if user_function throws, the channel is destroyed without being closed,
+        // which the host observes as an exception
+        channel.close();
       }
 
-      int port = 71342;
+      SERIALIZABLE_MEMBERS(user_function, host);
+    };
 
-      using result_type = typename std::result_of<ResultFactory()>::type;
-      using shared_parameter_type = typename std::result_of<SharedFactory()>::type;
+  public:
+    // creates n agents which each invoke f(idx, channel, shared_parameter), where channel is an
+    // interprocess_channel_writer<T>& through which the agent may push any number of values
+    // the returned interprocess_channel<T> receives those values while the agents are still running
+    template<class T, class Function, class SharedFactory>
+    interprocess_channel<T> streaming_bulk_execute(Function f, size_t n, SharedFactory shared_factory) const
+    {
+      // listen before creating the agents so that none of their connections are refused
+      acceptor host(0, n);
 
-      // execute start the client process using the one-way function
-      this->bulk_execute(twoway_bulk_execute_functor<result_type,shared_parameter_type,Function>{f, hostname, port}, n, pair_factory<ResultFactory,SharedFactory>{result_factory, shared_factory});
+      this->bulk_execute(streaming_bulk_execute_functor<T,Function>{f, host.endpoint()}, n, shared_factory);
 
-      // create a future corresponding to the client
-      return interprocess_future<result_type>{read_socket(port).release()};
+      return interprocess_channel<T>(std::move(host), n);
     }
 };
 
@@ -301,3 +696,7 @@ template<class Function, class SharedFactory>
 template<class T>
 uninitialized<T> shmem_executor::bulk_oneway_functor<Function,SharedFactory>::shared_parameter<T>::value;
 
+// define the symmetric deque declared above
+template<class Function>
+long long shmem_executor::work_stealing_functor<Function>::symmetric_deque;
+
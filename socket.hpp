@@ -29,18 +29,105 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <thread>
 #include <system_error>
 #include <iostream>
 #include <exception>
 
+
+// an endpoint names the place where a host process accepts connections
+// processes on the host's machine connect through an AF_UNIX socket in the abstract namespace,
+// which avoids DNS lookups and the TCP stack, while all other processes connect over TCP
+struct endpoint
+{
+  std::string hostname;
+  int port;
+  std::string local_name;
+
+  template<class OutputArchive>
+  friend void serialize(OutputArchive& ar, const endpoint& self)
+  {
+    ar(self.hostname, self.port, self.local_name);
+  }
+
+  template<class InputArchive>
+  friend void deserialize(InputArchive& ar, endpoint& self)
+  {
+    ar(self.hostname, self.port, self.local_name);
+  }
+};
+
+
+inline std::string this_hostname()
+{
+  char hostname[HOST_NAME_MAX];
+  if(gethostname(hostname, sizeof(hostname)) == -1)
+  {
+    throw std::system_error(errno, std::system_category(), "this_hostname(): Error after gethostname()");
+  }
+
+  return hostname;
+}
+
+
+// fills in an address in the abstract namespace, where names begin with a null byte and never touch the filesystem
+inline socklen_t make_local_address(const std::string& local_name, sockaddr_un& address)
+{
+  address = sockaddr_un{};
+  address.sun_family = AF_UNIX;
+
+  if(local_name.size() + 1 > sizeof(address.sun_path))
+  {
+    throw std::system_error(ENAMETOOLONG, std::system_category(), "make_local_address(): Name too long");
+  }
+
+  std::memcpy(address.sun_path + 1, local_name.data(), local_name.size());
+
+  return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + local_name.size());
+}
+
 class listening_socket
 {
   public:
-    listening_socket(int port)
-      : file_descriptor_(socket(AF_INET, SOCK_STREAM, 0))
+    // listens on a local socket in the abstract namespace
+    listening_socket(const std::string& local_name, int backlog = 1)
+      : file_descriptor_(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))
+    {
+      if(file_descriptor_ == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "listening_socket ctor: Error after socket()");
+      }
+
+      sockaddr_un address;
+      socklen_t address_length = make_local_address(local_name, address);
+
+      if(bind(file_descriptor_, reinterpret_cast<const sockaddr*>(&address), address_length) == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "listening_socket ctor: Error after bind()");
+      }
+
+      if(listen(file_descriptor_, backlog) == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "listening_socket ctor: Error after listen()");
+      }
+    }
+
+    listening_socket(int port, int backlog = 1)
+      : file_descriptor_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0))
     {
       if(file_descriptor_ == -1)
       {
@@ -67,8 +154,8 @@ class listening_socket
         throw std::system_error(errno, std::system_category(), "listening_socket ctor: Error after bind()");
       }
 
-      // make this socket a listening socket, listen for a single connection
-      if(listen(file_descriptor_, 1) == -1)
+      // make this socket a listening socket, by default listen for a single connection
+      if(listen(file_descriptor_, backlog) == -1)
       {
         throw std::system_error(errno, std::system_category(), "listening_socket ctor: Error after listen()");
       }
@@ -97,6 +184,34 @@ class listening_socket
       return file_descriptor_;
     }
 
+    // returns the port a TCP listening socket is bound to, which is useful after binding port 0
+    int port() const
+    {
+      sockaddr_in address{};
+      socklen_t address_length = sizeof(address);
+
+      if(getsockname(file_descriptor_, reinterpret_cast<sockaddr*>(&address), &address_length) == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "listening_socket::port(): Error after getsockname()");
+      }
+
+      // XXX ports are used without conversion to network byte order in this file, so return the port as stored
+      return address.sin_port;
+    }
+
+    // accepts a connection and returns its file descriptor
+    // the listening socket remains open for further connections
+    int accept()
+    {
+      int result = ::accept(file_descriptor_, nullptr, nullptr);
+      if(result == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "listening_socket::accept(): Error after accept()");
+      }
+
+      return result;
+    }
+
   private:
     int file_descriptor_;
 };
@@ -156,13 +271,8 @@ class write_socket
 {
   public:
     write_socket(const char* hostname, int port)
-      : file_descriptor_(socket(AF_INET, SOCK_STREAM, 0))
+      : file_descriptor_(-1)
     {
-      if(file_descriptor_ == -1)
-      {
-        throw std::system_error(errno, std::system_category(), "write_socket ctor: Error after socket()");
-      }
-
       // get the address of the server
       struct hostent* server = gethostbyname(hostname);
       if(server == nullptr)
@@ -176,22 +286,167 @@ class write_socket
       std::memcpy(&server_address.sin_addr.s_addr, server->h_addr, server->h_length);
       server_address.sin_port = port;
 
-      // keep attempting a connection while the server refuses
-      int attempt = 0;
-      int connect_result = 0;
-      while((connect_result = connect(file_descriptor_, reinterpret_cast<sockaddr*>(&server_address), sizeof(server_address))) == -1 && attempt < 1000)
+      file_descriptor_ = connect_with_backoff(AF_INET, reinterpret_cast<sockaddr*>(&server_address), sizeof(server_address));
+    }
+
+    // connects locally when this process runs on the endpoint's host, and over TCP otherwise
+    explicit write_socket(const endpoint& e)
+      : write_socket(e.local_name.empty() || this_hostname() != e.hostname ?
+                     write_socket(e.hostname.c_str(), e.port) :
+                     write_socket(e.local_name))
+    {}
+
+    write_socket(write_socket&& other)
+      : file_descriptor_(-1)
+    {
+      std::swap(file_descriptor_, other.file_descriptor_);
+    }
+
+    int get() const
+    {
+      return file_descriptor_;
+    }
+
+  private:
+    explicit write_socket(const std::string& local_name)
+      : file_descriptor_(-1)
+    {
+      sockaddr_un address;
+      socklen_t address_length = make_local_address(local_name, address);
+
+      file_descriptor_ = connect_with_backoff(AF_UNIX, reinterpret_cast<sockaddr*>(&address), address_length);
+    }
+
+    // connects without blocking indefinitely, and while the server refuses (e.g., because it is not yet listening),
+    // sleeps for exponentially increasing intervals before trying again
+    // gives up once the server has been unreachable for max_connect_time
+    static int connect_with_backoff(int domain, const sockaddr* address, socklen_t address_length)
+    {
+      using clock = std::chrono::steady_clock;
+
+      const std::chrono::seconds max_connect_time(60);
+      const std::chrono::milliseconds max_delay(256);
+
+      const clock::time_point deadline = clock::now() + max_connect_time;
+      std::chrono::milliseconds delay(1);
+
+      while(true)
       {
-        if(errno != ECONNREFUSED)
+        int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(fd == -1)
+        {
+          throw std::system_error(errno, std::system_category(), "write_socket ctor: Error after socket()");
+        }
+
+        int error = 0;
+        if(connect(fd, address, address_length) == -1)
+        {
+          error = errno;
+
+          if(error == EINPROGRESS)
+          {
+            error = wait_for_connection(fd, deadline);
+          }
+        }
+
+        if(error == 0)
         {
-          throw std::system_error(errno, std::system_category(), "write_socket ctor: Error after connect()");
+          // the connection is established; the socket is used with blocking writes from here on
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+          return fd;
         }
 
-        ++attempt;
+        close(fd);
+
+        // a refused connection is retried, as is a local listener whose backlog is full
+        bool retry = error == ECONNREFUSED || error == EAGAIN;
+
+        if(!retry || clock::now() + delay > deadline)
+        {
+          throw std::system_error(error, std::system_category(), "write_socket ctor: Error after connect()");
+        }
+
+        std::this_thread::sleep_for(delay);
+        delay = std::min(2 * delay, max_delay);
+      }
+    }
+
+    // waits for a non-blocking connection attempt to complete and returns its error code
+    static int wait_for_connection(int fd, std::chrono::steady_clock::time_point deadline)
+    {
+      auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+      pollfd request{fd, POLLOUT, 0};
+
+      int num_ready = 0;
+      while((num_ready = poll(&request, 1, std::max<int>(0, timeout.count()))) == -1 && errno == EINTR);
+
+      if(num_ready == -1)
+      {
+        return errno;
+      }
+
+      if(num_ready == 0)
+      {
+        return ETIMEDOUT;
+      }
+
+      int error = 0;
+      socklen_t error_length = sizeof(error);
+      if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1)
+      {
+        return errno;
+      }
+
+      return error;
+    }
+
+    int file_descriptor_;
+};
+
+
+// an acceptor listens for connections to an endpoint through both of its transports
+// get() returns an epoll file descriptor which polls as readable whenever a connection is waiting to be accepted
+// by default, the acceptor listens on a TCP port chosen by the system, so any number of acceptors may coexist
+class acceptor
+{
+  public:
+    acceptor(int port = 0, int backlog = 1)
+      : local_name_(make_local_name()),
+        tcp_(port, backlog),
+        local_(local_name_, backlog),
+        file_descriptor_(epoll_create1(EPOLL_CLOEXEC))
+    {
+      if(file_descriptor_ == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "acceptor ctor: Error after epoll_create1()");
       }
 
-      if(connect_result == -1)
+      add_to_epoll(tcp_.get());
+      add_to_epoll(local_.get());
+
+      endpoint_ = ::endpoint{this_hostname(), tcp_.port(), local_name_};
+    }
+
+    acceptor(acceptor&& other)
+      : local_name_(std::move(other.local_name_)),
+        tcp_(std::move(other.tcp_)),
+        local_(std::move(other.local_)),
+        file_descriptor_(-1),
+        endpoint_(std::move(other.endpoint_))
+    {
+      std::swap(file_descriptor_, other.file_descriptor_);
+    }
+
+    ~acceptor()
+    {
+      if(file_descriptor_ != -1)
       {
-        throw std::system_error(errno, std::system_category(), "write_socket ctor: Error after connect()");
+        if(close(file_descriptor_) == -1)
+        {
+          std::cerr << "acceptor dtor: Error after close()" << std::endl;
+          std::terminate();
+        }
       }
     }
 
@@ -200,7 +455,51 @@ class write_socket
       return file_descriptor_;
     }
 
+    const ::endpoint& endpoint() const
+    {
+      return endpoint_;
+    }
+
+    // waits for a connection through either transport and returns its file descriptor
+    int accept()
+    {
+      epoll_event event;
+
+      int num_events = 0;
+      while((num_events = epoll_wait(file_descriptor_, &event, 1, -1)) == -1 && errno == EINTR);
+
+      if(num_events == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "acceptor::accept(): Error after epoll_wait()");
+      }
+
+      return event.data.fd == tcp_.get() ? tcp_.accept() : local_.accept();
+    }
+
   private:
+    static std::string make_local_name()
+    {
+      static std::atomic<int> counter(0);
+
+      return "shmem_executor." + std::to_string(getpid()) + "." + std::to_string(counter++);
+    }
+
+    void add_to_epoll(int fd)
+    {
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+
+      if(epoll_ctl(file_descriptor_, EPOLL_CTL_ADD, fd, &event) == -1)
+      {
+        throw std::system_error(errno, std::system_category(), "acceptor ctor: Error after epoll_ctl()");
+      }
+    }
+
+    std::string local_name_;
+    listening_socket tcp_;
+    listening_socket local_;
     int file_descriptor_;
+    ::endpoint endpoint_;
 };
 
@@ -52,53 +52,15 @@ class basic_string_view_stream : public std::basic_istream<CharT>
         using pos_type = typename traits_type::pos_type;
         using off_type = typename traits_type::off_type;
     
+        // the view is the buffer's get area, so bulk reads copy directly from it
+        // and characters are never written back into it, because putting back a different character fails
         string_view_buffer(const char* data, std::size_t size)
-          : begin_(data),
-            end_(data + size),
-            current_(data)
-        {}
-    
-        string_view_buffer(const string_view_buffer&) = delete;
-    
-      protected:
-        const char_type* begin_;
-        const char_type* end_;
-        const char_type* current_;
-    
-        int_type underflow() override
-        {
-          if(current_ == end_)
-          {
-            return traits_type::eof();
-          }
-    
-          return traits_type::to_int_type(*current_);
-        }
-    
-        int_type uflow() override
         {
-          if(current_ == end_)
-          {
-            return traits_type::eof();
-          }
-    
-          return traits_type::to_int_type(*current_++);
-        }
-    
-        int_type pbackfail(int_type c) override
-        {
-          if(current_ == begin_ || (c != traits_type::eof() && c != current_[-1]))
-          {
-            return traits_type::eof();
-          }
-    
-          return traits_type::to_int_type(*--current_);
+          char_type* begin = const_cast<char_type*>(data);
+          setg(begin, begin, begin + size);
         }
     
-        std::streamsize showmanyc() override
-        {
-          return end_ - current_;
-        }
+        string_view_buffer(const string_view_buffer&) = delete;
     };
 
     string_view_buffer buffer_;
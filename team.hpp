@@ -0,0 +1,460 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <shmem.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+
+// a team is a group of processing elements whose collective operations involve only the team's members,
+// so that disjoint teams synchronize independently of each other and of the processing elements outside them
+//
+// collectives are built from point-to-point puts and atomics on symmetric scratch memory:
+// barrier uses the dissemination algorithm, while reduce and broadcast use binomial trees
+// every member of a team must call the team's collective operations, including split_*, in the same order
+class team
+{
+  public:
+    // the team of all processing elements, in which each member's rank is its processing element number
+    static team world()
+    {
+      std::vector<int> members(shmem_n_pes());
+      std::iota(members.begin(), members.end(), 0);
+
+      return team(0, std::move(members));
+    }
+
+    // processing elements excluded from a split receive an invalid team
+    bool valid() const
+    {
+      return static_cast<bool>(members_);
+    }
+
+    std::size_t size() const
+    {
+      return members_->size();
+    }
+
+    // this processing element's index within the team
+    std::size_t rank() const
+    {
+      return rank_;
+    }
+
+    // the processing element number of the team member with the given rank
+    int processing_element(std::size_t rank) const
+    {
+      return (*members_)[rank];
+    }
+
+    // collective over this team
+    // creates a team of the members ranked start, start + stride, start + 2 * stride, ..., with at most size members
+    team split_strided(std::size_t start, std::size_t stride, std::size_t size) const
+    {
+      std::size_t slot = agree_on_slot();
+
+      std::vector<int> members;
+      std::size_t new_rank = 0;
+      bool included = false;
+
+      for(std::size_t r = start; r < this->size() && members.size() < size; r += stride)
+      {
+        if(r == rank_)
+        {
+          new_rank = members.size();
+          included = true;
+        }
+
+        members.push_back(processing_element(r));
+      }
+
+      return included ? team(slot, std::move(members), new_rank) : team();
+    }
+
+    // collective over this team
+    // creates a team for each distinct non-negative color, whose members are ranked by key and then by rank in this team
+    // members which pass a negative color receive an invalid team
+    team split_color(int color, int key) const
+    {
+      if(size() > max_split_members)
+      {
+        throw std::length_error("team::split_color(): Team is too large to split by color.");
+      }
+
+      std::size_t slot = agree_on_slot();
+
+      // gather every member's color & key into a table ordered by rank, and share the table with every member
+      long long (*table)[2] = split_table<void>::value;
+      table[rank_][0] = color;
+      table[rank_][1] = key;
+
+      gather_and_broadcast_split_table();
+
+      if(color < 0)
+      {
+        return team();
+      }
+
+      // collect the members which share this member's color
+      std::vector<std::tuple<long long, std::size_t, int>> members_by_key;
+
+      for(std::size_t r = 0; r < size(); ++r)
+      {
+        if(table[r][0] == color)
+        {
+          members_by_key.emplace_back(table[r][1], r, processing_element(r));
+        }
+      }
+
+      std::sort(members_by_key.begin(), members_by_key.end());
+
+      std::vector<int> members;
+      std::size_t new_rank = 0;
+
+      for(const auto& member : members_by_key)
+      {
+        if(std::get<1>(member) == rank_)
+        {
+          new_rank = members.size();
+        }
+
+        members.push_back(std::get<2>(member));
+      }
+
+      return team(slot, std::move(members), new_rank);
+    }
+
+    void barrier() const
+    {
+      scratch& s = storage();
+      long long epoch = ++s.barrier_epoch;
+
+      // complete this member's outstanding puts before announcing its arrival
+      shmem_quiet();
+
+      // in each round, signal the member distance ranks ahead, and wait for the member distance ranks behind
+      for(std::size_t round = 0, distance = 1; distance < size(); ++round, distance *= 2)
+      {
+        shmem_longlong_atomic_inc(&s.barrier_counters[round], processing_element((rank_ + distance) % size()));
+        shmem_longlong_wait_until(&s.barrier_counters[round], SHMEM_CMP_GE, epoch);
+      }
+    }
+
+    // combines every member's value with op and returns the result to every member
+    // T must be trivially copyable and no larger than a long long
+    template<class T, class BinaryOperation>
+    T reduce(T value, BinaryOperation op) const
+    {
+      static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(long long), "team::reduce(): T must be trivially copyable and no larger than long long.");
+
+      scratch& s = storage();
+      long long epoch = ++s.reduce_epoch;
+
+      // combine values toward rank 0
+      for(std::size_t round = 0, distance = 1; distance < size(); ++round, distance *= 2)
+      {
+        if(rank_ & distance)
+        {
+          send(s.reduce_values, s.reduce_flags, round, processing_element(rank_ - distance), value, epoch);
+          break;
+        }
+
+        if(rank_ + distance < size())
+        {
+          value = op(value, receive<T>(s.reduce_values, s.reduce_flags, round, epoch));
+        }
+      }
+
+      return broadcast(value, 0);
+    }
+
+    // returns the root's value to every member
+    // T must be trivially copyable and no larger than a long long
+    template<class T>
+    T broadcast(T value, std::size_t root) const
+    {
+      static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(long long), "team::broadcast(): T must be trivially copyable and no larger than long long.");
+
+      scratch& s = storage();
+      long long epoch = ++s.broadcast_epoch;
+
+      // ranks relative to the root
+      std::size_t relative_rank = (rank_ + size() - root) % size();
+
+      // receive from the parent, whose relative rank lacks this member's highest set bit
+      std::size_t round = 0;
+      if(relative_rank != 0)
+      {
+        while((std::size_t(2) << round) <= relative_rank) ++round;
+
+        value = receive<T>(s.broadcast_values, s.broadcast_flags, round, epoch);
+
+        ++round;
+      }
+
+      // send to the children, whose relative ranks add a higher bit to this member's
+      for(std::size_t distance = std::size_t(1) << round; distance < size(); ++round, distance *= 2)
+      {
+        if(relative_rank + distance < size())
+        {
+          send(s.broadcast_values, s.broadcast_flags, round, processing_element((relative_rank + distance + root) % size()), value, epoch);
+        }
+      }
+
+      // no member may send into the mailboxes again until every member has received
+      barrier();
+
+      return value;
+    }
+
+  private:
+    static constexpr std::size_t max_teams = 128;
+    static constexpr std::size_t max_rounds = 32;
+    static constexpr std::size_t max_split_members = 1 << 16;
+    static constexpr std::size_t bits_per_word = 64;
+
+    // the symmetric scratch memory used by a single team's collectives
+    struct scratch
+    {
+      // incremented by a peer during each round of a barrier
+      long long barrier_counters[max_rounds];
+
+      // values received during each round of a reduction or broadcast, and the epoch in which each was sent
+      long long reduce_values[max_rounds];
+      long long reduce_flags[max_rounds];
+      long long broadcast_values[max_rounds];
+      long long broadcast_flags[max_rounds];
+
+      // the epoch in which a subtree's entries of the split table arrived during each round of split_color,
+      // and the epoch in which the whole table arrived
+      long long gather_flags[max_rounds];
+      long long table_flags[max_rounds];
+
+      // the number of each collective this processing element has begun; these are only accessed locally
+      long long barrier_epoch;
+      long long reduce_epoch;
+      long long broadcast_epoch;
+      long long split_epoch;
+    };
+
+    // XXX in C++17, these would just be inline variables
+    template<class Dummy>
+    struct symmetric_storage
+    {
+      static scratch value[max_teams];
+    };
+
+    // each member's color & key during split_color, indexed by rank
+    // a processing element takes part in one collective at a time, so every team shares this table
+    template<class Dummy>
+    struct split_table
+    {
+      static long long value[max_split_members][2];
+    };
+
+    // the slots of the teams to which this processing element belongs; the world's slot 0 is always in use
+    static unsigned long long* slots_in_use()
+    {
+      static unsigned long long result[max_teams / bits_per_word] = {1};
+      return result;
+    }
+
+    // destroys a team's members when its last copy on this processing element goes away, and releases its slot
+    struct release_slot
+    {
+      std::size_t slot;
+
+      void operator()(const std::vector<int>* members) const
+      {
+        if(slot != 0)
+        {
+          slots_in_use()[slot / bits_per_word] &= ~(1ull << (slot % bits_per_word));
+        }
+
+        delete members;
+      }
+    };
+
+    team() = default;
+
+    team(std::size_t slot, std::vector<int>&& members, std::size_t rank)
+      : slot_(slot),
+        rank_(rank),
+        members_(new std::vector<int>(std::move(members)), release_slot{slot})
+    {
+      slots_in_use()[slot / bits_per_word] |= 1ull << (slot % bits_per_word);
+    }
+
+    team(std::size_t slot, std::vector<int>&& members)
+      : team(slot, std::move(members), shmem_my_pe())
+    {}
+
+    scratch& storage() const
+    {
+      return symmetric_storage<void>::value[slot_];
+    }
+
+    // every member of this team chooses the same scratch slot for a new team: the lowest slot which no member's teams use
+    // a new team's members are members of this team, so the slot is unused on every one of them
+    std::size_t agree_on_slot() const
+    {
+      std::size_t slot = max_teams;
+
+      for(std::size_t word = 0; word < max_teams / bits_per_word && slot == max_teams; ++word)
+      {
+        unsigned long long in_use = reduce(slots_in_use()[word], [](unsigned long long a, unsigned long long b)
+        {
+          return a | b;
+        });
+
+        for(std::size_t bit = 0; bit < bits_per_word; ++bit)
+        {
+          if(!(in_use & (1ull << bit)))
+          {
+            slot = word * bits_per_word + bit;
+            break;
+          }
+        }
+      }
+
+      if(slot == max_teams)
+      {
+        throw std::runtime_error("team: Too many teams in use.");
+      }
+
+      // a released slot still holds the counters and epochs of its previous team
+      std::memset(&symmetric_storage<void>::value[slot], 0, sizeof(scratch));
+
+      // no member may use the slot until every member has reset it
+      barrier();
+
+      return slot;
+    }
+
+    // gathers each member's row of the split table toward rank 0 over a binomial tree,
+    // and then sends the whole table back down the tree
+    void gather_and_broadcast_split_table() const
+    {
+      scratch& s = storage();
+      long long epoch = ++s.split_epoch;
+      long long (*table)[2] = split_table<void>::value;
+
+      // each member forwards its subtree, whose ranks are contiguous, into the same rows of its parent's table
+      std::size_t subtree_size = 1;
+      for(std::size_t round = 0, distance = 1; distance < size(); ++round, distance *= 2)
+      {
+        if(rank_ & distance)
+        {
+          int parent = processing_element(rank_ - distance);
+
+          shmem_putmem(&table[rank_], &table[rank_], subtree_size * sizeof(table[0]), parent);
+
+          // the rows must arrive before the flag announcing them
+          shmem_fence();
+          shmem_longlong_p(&s.gather_flags[round], epoch, parent);
+          break;
+        }
+
+        if(rank_ + distance < size())
+        {
+          shmem_longlong_wait_until(&s.gather_flags[round], SHMEM_CMP_GE, epoch);
+        }
+
+        subtree_size = std::min(2 * distance, size() - rank_);
+      }
+
+      // receive the whole table from the parent, whose rank lacks this member's highest set bit
+      std::size_t round = 0;
+      if(rank_ != 0)
+      {
+        while((std::size_t(2) << round) <= rank_) ++round;
+
+        shmem_longlong_wait_until(&s.table_flags[round], SHMEM_CMP_GE, epoch);
+
+        ++round;
+      }
+
+      // send the whole table to the children, whose ranks add a higher bit to this member's
+      for(std::size_t distance = std::size_t(1) << round; distance < size(); ++round, distance *= 2)
+      {
+        if(rank_ + distance < size())
+        {
+          int child = processing_element(rank_ + distance);
+
+          shmem_putmem(table, table, size() * sizeof(table[0]), child);
+          shmem_fence();
+          shmem_longlong_p(&s.table_flags[round], epoch, child);
+        }
+      }
+
+      // no member may write into the table again until every member has received it
+      barrier();
+    }
+
+    template<class T>
+    static void send(long long* values, long long* flags, std::size_t round, int pe, const T& value, long long epoch)
+    {
+      long long encoded = 0;
+      std::memcpy(&encoded, &value, sizeof(T));
+
+      shmem_longlong_p(&values[round], encoded, pe);
+
+      // the value must arrive before the flag announcing it
+      shmem_fence();
+      shmem_longlong_p(&flags[round], epoch, pe);
+    }
+
+    template<class T>
+    static T receive(long long* values, long long* flags, std::size_t round, long long epoch)
+    {
+      shmem_longlong_wait_until(&flags[round], SHMEM_CMP_GE, epoch);
+
+      T result;
+      std::memcpy(&result, &values[round], sizeof(T));
+      return result;
+    }
+
+    std::size_t slot_ = 0;
+    std::size_t rank_ = 0;
+    std::shared_ptr<const std::vector<int>> members_;
+};
+
+// define the symmetric scratch memory declared above
+template<class Dummy>
+team::scratch team::symmetric_storage<Dummy>::value[team::max_teams];
+
+template<class Dummy>
+long long team::split_table<Dummy>::value[team::max_split_members][2];
+
@@ -0,0 +1,353 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+// this file implements a lightweight tracing layer which records timestamped spans
+// around the phases of process creation and bulk execution
+//
+// tracing is compiled in only when SHMEM_EXECUTOR_ENABLE_TRACING is defined; otherwise,
+// __TRACE_SPAN expands to nothing and the functions below are no-ops
+//
+// each thread records spans into its own fixed-size ring buffer, which requires no synchronization
+// before a spawned process exits, it writes its spans to a fragment file named after the trace file and the
+// host process's id, which spawned processes inherit through the environment variable SHMEM_EXECUTOR_TRACE_HOST
+// the host process, after waiting on the processes it spawned, merges its own fragments into a single
+// Chrome trace (viewable in chrome://tracing or Perfetto) whose path is given by the environment
+// variable SHMEM_EXECUTOR_TRACE_FILE, or shmem_executor_trace.json by default
+
+#include <string>
+
+#if defined(SHMEM_EXECUTOR_ENABLE_TRACING)
+
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace trace
+{
+namespace detail
+{
+
+
+struct event
+{
+  const char* name;
+  std::uint64_t begin_ns;
+  std::uint64_t end_ns;
+};
+
+
+inline std::uint64_t now_ns()
+{
+  // use the realtime clock so that timestamps from different processes on the same node share an origin
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+
+// a ring buffer of events written by a single thread
+// when the buffer is full, new events overwrite the oldest ones
+class event_buffer
+{
+  public:
+    static constexpr size_t capacity = 1 << 14;
+
+    explicit event_buffer(int thread_id)
+      : thread_id_(thread_id), num_events_(0), events_(new event[capacity])
+    {}
+
+    void push(const event& e)
+    {
+      events_[num_events_ % capacity] = e;
+      ++num_events_;
+    }
+
+    int thread_id() const
+    {
+      return thread_id_;
+    }
+
+    template<class Function>
+    void for_each(Function f) const
+    {
+      size_t begin = num_events_ > capacity ? num_events_ - capacity : 0;
+
+      for(size_t i = begin; i < num_events_; ++i)
+      {
+        f(events_[i % capacity]);
+      }
+    }
+
+  private:
+    int thread_id_;
+    size_t num_events_;
+    std::unique_ptr<event[]> events_;
+};
+
+
+// the state of tracing in this process
+class session
+{
+  public:
+    session()
+      : process_name_("process " + std::to_string(getpid())), is_spawned_(false)
+    {}
+
+    // the calling thread's buffer; registering a thread's buffer is the only operation which locks
+    event_buffer& buffer()
+    {
+      thread_local event_buffer* result = nullptr;
+
+      if(!result)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.emplace_back(new event_buffer(buffers_.size()));
+        result = buffers_.back().get();
+      }
+
+      return *result;
+    }
+
+    void set_process_name(const std::string& name)
+    {
+      process_name_ = name;
+    }
+
+    // spawned processes leave their events in a fragment for the host to merge
+    void finalize_spawned_process()
+    {
+      is_spawned_ = true;
+
+      std::ofstream os(fragment_prefix() + std::to_string(getpid()));
+      write_events(os);
+    }
+
+    // merges this process's events with the fragments left by the processes it spawned
+    void finalize_host()
+    {
+      // spawned processes have already finalized
+      if(is_spawned_) return;
+
+      std::string path = trace_filename();
+
+      std::ofstream os(path);
+      os << "{\"traceEvents\":[\n";
+
+      write_events(os);
+
+      // find the fragments left by this host's spawned processes, ignoring those of other hosts and of earlier runs
+      std::string directory = ".";
+      std::string prefix = fragment_prefix();
+
+      size_t slash = prefix.rfind('/');
+      if(slash != std::string::npos)
+      {
+        directory = prefix.substr(0, slash);
+        prefix = prefix.substr(slash + 1);
+      }
+
+      if(DIR* dir = opendir(directory.c_str()))
+      {
+        while(dirent* entry = readdir(dir))
+        {
+          std::string name = entry->d_name;
+          if(name.compare(0, prefix.size(), prefix) == 0)
+          {
+            std::string fragment_path = directory + "/" + name;
+
+            std::ifstream fragment(fragment_path);
+            os << ",\n" << fragment.rdbuf();
+
+            std::remove(fragment_path.c_str());
+          }
+        }
+
+        closedir(dir);
+      }
+
+      os << "\n]}\n";
+    }
+
+  private:
+    static std::string trace_filename()
+    {
+      const char* variable = std::getenv("SHMEM_EXECUTOR_TRACE_FILE");
+      return variable ? variable : "shmem_executor_trace.json";
+    }
+
+    // fragments are named <trace file>.<host id>.<spawned process id>
+    static std::string fragment_prefix()
+    {
+      return trace_filename() + "." + host_id() + ".";
+    }
+
+  public:
+    // the id of the host process which merges this process's fragment
+    // a process which did not inherit a host id is itself the host
+    static std::string host_id()
+    {
+      const char* variable = std::getenv(host_variable_name);
+      return variable ? variable : std::to_string(getpid());
+    }
+
+    static constexpr const char* host_variable_name = "SHMEM_EXECUTOR_TRACE_HOST";
+
+  private:
+
+    // writes this process's events as a comma-separated list of Chrome trace events
+    void write_events(std::ostream& os)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      pid_t pid = getpid();
+
+      // name this process's track
+      os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"" << process_name_ << "\"}}";
+
+      for(const auto& buffer : buffers_)
+      {
+        buffer->for_each([&](const event& e)
+        {
+          os << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\""
+             << ",\"ts\":" << e.begin_ns / 1000 << "." << (e.begin_ns % 1000) / 100
+             << ",\"dur\":" << (e.end_ns - e.begin_ns) / 1000 << "." << ((e.end_ns - e.begin_ns) % 1000) / 100
+             << ",\"pid\":" << pid
+             << ",\"tid\":" << buffer->thread_id() << "}";
+        });
+      }
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<event_buffer>> buffers_;
+    std::string process_name_;
+    bool is_spawned_;
+};
+
+
+inline session& this_session()
+{
+  // the session is intentionally never destroyed so that spans may be recorded
+  // and finalized during the destruction of other static objects
+  static session* result = new session;
+  return *result;
+}
+
+
+} // end detail
+
+
+// span records the interval between its construction and destruction
+class span
+{
+  public:
+    explicit span(const char* name)
+      : buffer_(detail::this_session().buffer()), name_(name), begin_ns_(detail::now_ns())
+    {}
+
+    span(const span&) = delete;
+
+    ~span()
+    {
+      buffer_.push(detail::event{name_, begin_ns_, detail::now_ns()});
+    }
+
+  private:
+    detail::event_buffer& buffer_;
+    const char* name_;
+    std::uint64_t begin_ns_;
+};
+
+
+// names this process's track in the merged trace, e.g. "PE 3"
+inline void set_process_name(const std::string& name)
+{
+  detail::this_session().set_process_name(name);
+}
+
+// writes the spans of a process spawned by a process_context to a fragment for the host to merge
+// this should be called just before the spawned process exits
+inline void finalize_spawned_process()
+{
+  detail::this_session().finalize_spawned_process();
+}
+
+// returns the environment variable, e.g. SHMEM_EXECUTOR_TRACE_HOST=1234, which a spawned process requires
+// to name its fragment after its host, or an empty string when the variable is already in this process's environment
+inline std::string host_variable()
+{
+  using detail::session;
+  return std::getenv(session::host_variable_name) ? std::string() : std::string(session::host_variable_name) + "=" + session::host_id();
+}
+
+// merges the host's spans with the fragments of the processes it spawned into the trace file
+// this should be called after every spawned process has exited
+inline void finalize_host()
+{
+  detail::this_session().finalize_host();
+}
+
+
+} // end trace
+
+
+#define __TRACE_CONCATENATE_IMPL(x, y) x##y
+
+#define __TRACE_CONCATENATE(x, y) __TRACE_CONCATENATE_IMPL(x, y)
+
+#define __TRACE_SPAN(name) ::trace::span __TRACE_CONCATENATE(__trace_span, __COUNTER__)(name)
+
+#else
+
+namespace trace
+{
+
+
+inline void set_process_name(const std::string&) {}
+
+inline std::string host_variable() { return std::string(); }
+
+inline void finalize_spawned_process() {}
+
+inline void finalize_host() {}
+
+
+} // end trace
+
+#define __TRACE_SPAN(name)
+
+#endif
@@ -39,12 +39,50 @@ static std::tuple<Ts...> tail_impl(index_sequence<Indices...>, const std::tuple<
   return std::tuple<Ts...>(std::get<1 + Indices>(t)...);
 }
 
+template<size_t... Indices, class T, class... Ts>
+static std::tuple<Ts...> tail_impl(index_sequence<Indices...>, std::tuple<T,Ts...>&& t)
+{
+  return std::tuple<Ts...>(std::get<1 + Indices>(std::move(t))...);
+}
+
 template<class T, class... Ts>
 static std::tuple<Ts...> tail(const std::tuple<T,Ts...>& t)
 {
   return tail_impl(make_index_sequence<sizeof...(Ts)>(), t);
 }
 
+// moves the elements of t after the first into the result
+template<class T, class... Ts>
+static std::tuple<Ts...> tail(std::tuple<T,Ts...>&& t)
+{
+  return tail_impl(make_index_sequence<sizeof...(Ts)>(), std::move(t));
+}
+
+
+template<size_t... Indices, class Tuple>
+static auto tail_view_impl(index_sequence<Indices...>, Tuple&& t) ->
+  decltype(
+    std::forward_as_tuple(std::get<1 + Indices>(std::forward<Tuple>(t))...)
+  )
+{
+  return std::forward_as_tuple(std::get<1 + Indices>(std::forward<Tuple>(t))...);
+}
+
+// returns a tuple of references to the elements of t after the first
+// the references are rvalue references when t is an rvalue, so applying a function to the view moves from t
+template<class Tuple>
+static auto tail_view(Tuple&& t) ->
+  decltype(
+    tail_view_impl(
+      make_index_sequence<std::tuple_size<typename std::decay<Tuple>::type>::value - 1>(),
+      std::forward<Tuple>(t)
+    )
+  )
+{
+  static constexpr size_t num_elements = std::tuple_size<typename std::decay<Tuple>::type>::value;
+  return tail_view_impl(make_index_sequence<num_elements - 1>(), std::forward<Tuple>(t));
+}
+
 template<size_t... Indices, class Function, class Tuple>
 static auto apply_impl(index_sequence<Indices...>, Function&& f, Tuple&& t) ->
   decltype(
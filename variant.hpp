@@ -770,57 +770,124 @@ namespace variant_detail
 {
 
 
-template<typename VisitorReference, typename Result, typename T, typename... Types>
-struct apply_visitor_impl : apply_visitor_impl<VisitorReference,Result,Types...>
+// apply_visitor dispatches on a variant's index through a table of function pointers with one entry per alternative,
+// so visitation costs a single indirect call however many alternatives there are
+template<typename VisitorReference, typename Result, typename Variant>
+struct apply_visitor;
+
+
+template<typename VisitorReference, typename Result, typename... Types>
+struct apply_visitor<VisitorReference,Result,variant<Types...>>
 {
-  typedef apply_visitor_impl<VisitorReference,Result,Types...> super_t;
+  template<typename T>
+  static Result invoke(VisitorReference visitor, void* ptr)
+  {
+    return visitor(*reinterpret_cast<T*>(ptr));
+  }
+
+  template<typename T>
+  static Result invoke_const(VisitorReference visitor, const void* ptr)
+  {
+    return visitor(*reinterpret_cast<const T*>(ptr));
+  }
+
+  static Result do_it(VisitorReference visitor, void* ptr, size_t index)
+  {
+    using function_ptr_type = Result (*)(VisitorReference, void*);
+    static constexpr function_ptr_type table[] = {&invoke<Types>...};
+
+    return table[index](visitor, ptr);
+  }
+
+  static Result do_it(VisitorReference visitor, const void* ptr, size_t index)
+  {
+    using function_ptr_type = Result (*)(VisitorReference, const void*);
+    static constexpr function_ptr_type table[] = {&invoke_const<Types>...};
+
+    return table[index](visitor, ptr);
+  }
+};
+
 
+// variants of two alternatives, such as the ones transmitted between interprocess promises and futures,
+// dispatch with a single branch rather than through a table
+template<typename VisitorReference, typename Result, typename T0, typename T1>
+struct apply_visitor<VisitorReference,Result,variant<T0,T1>>
+{
   static Result do_it(VisitorReference visitor, void* ptr, size_t index)
   {
     if(index == 0)
     {
-      return visitor(*reinterpret_cast<T*>(ptr));
+      return visitor(*reinterpret_cast<T0*>(ptr));
     }
 
-    return super_t::do_it(visitor, ptr, --index);
+    return visitor(*reinterpret_cast<T1*>(ptr));
   }
 
-
   static Result do_it(VisitorReference visitor, const void* ptr, size_t index)
   {
     if(index == 0)
     {
-      return visitor(*reinterpret_cast<const T*>(ptr));
+      return visitor(*reinterpret_cast<const T0*>(ptr));
     }
 
-    return super_t::do_it(visitor, ptr, --index);
+    return visitor(*reinterpret_cast<const T1*>(ptr));
   }
 };
 
 
-template<typename VisitorReference, typename Result, typename T>
-struct apply_visitor_impl<VisitorReference,Result,T>
+// the type of pointer through which a variant's storage is visited
+template<typename VariantReference>
+using variant_pointer_t = typename std::conditional<
+  std::is_const<typename std::remove_reference<VariantReference>::type>::value,
+  const void*,
+  void*
+>::type;
+
+
+// T, const-qualified like the pointee of Pointer
+template<typename Pointer, typename T>
+using qualify_like_pointee_t = typename std::conditional<
+  std::is_const<typename std::remove_pointer<Pointer>::type>::value,
+  const T,
+  T
+>::type;
+
+
+// apply_binary_visitor dispatches on a pair of indices through a single flat table
+// with one entry per combination of alternatives
+template<typename VisitorReference, typename Result, typename Pointer1, typename Pointer2, typename Variant1, typename Variant2>
+struct apply_binary_visitor;
+
+
+template<typename VisitorReference, typename Result, typename Pointer1, typename Pointer2, typename... Types1, typename... Types2>
+struct apply_binary_visitor<VisitorReference,Result,Pointer1,Pointer2,variant<Types1...>,variant<Types2...>>
 {
-  static Result do_it(VisitorReference visitor, void* ptr, size_t)
-  {
-    return visitor(*reinterpret_cast<T*>(ptr));
-  }
+  static const size_t num_alternatives2 = sizeof...(Types2);
 
-  static Result do_it(VisitorReference visitor, const void* ptr, size_t)
+  template<size_t k>
+  static Result invoke(VisitorReference visitor, Pointer1 ptr1, Pointer2 ptr2)
   {
-    return visitor(*reinterpret_cast<const T*>(ptr));
-  }
-};
+    using T = qualify_like_pointee_t<Pointer1, variant_alternative_t<k / num_alternatives2, variant<Types1...>>>;
+    using U = qualify_like_pointee_t<Pointer2, variant_alternative_t<k % num_alternatives2, variant<Types2...>>>;
 
+    return visitor(*reinterpret_cast<T*>(ptr1), *reinterpret_cast<U*>(ptr2));
+  }
 
-template<typename VisitorReference, typename Result, typename Variant>
-struct apply_visitor;
+  template<size_t... ks>
+  static Result do_it(VisitorReference visitor, Pointer1 ptr1, Pointer2 ptr2, size_t k, index_sequence<ks...>)
+  {
+    using function_ptr_type = Result (*)(VisitorReference, Pointer1, Pointer2);
+    static constexpr function_ptr_type table[] = {&invoke<ks>...};
 
+    return table[k](visitor, ptr1, ptr2);
+  }
 
-template<typename VisitorReference, typename Result, typename... Types>
-struct apply_visitor<VisitorReference,Result,variant<Types...>>
-  : apply_visitor_impl<VisitorReference,Result,Types...>
-{};
+  static Result do_it(VisitorReference visitor, Pointer1 ptr1, size_t index1, Pointer2 ptr2, size_t index2)
+  {
+    return do_it(visitor, ptr1, ptr2, index1 * num_alternatives2 + index2, make_index_sequence<sizeof...(Types1) * sizeof...(Types2)>());
+  }
+};
 
 
 } // end variant_detail
@@ -859,65 +926,6 @@ typename std::result_of<
 }
 
 
-namespace detail
-{
-namespace variant_detail
-{
-
-
-template<typename VisitorReference, typename Result, typename ElementReference>
-struct unary_visitor_binder
-{
-  VisitorReference visitor;
-  ElementReference x;
-
-  unary_visitor_binder(VisitorReference visitor, ElementReference x) : visitor(visitor), x(x) {}
-
-  template<typename T>
-  Result operator()(T&& y)
-  {
-    return visitor(x, std::forward<T>(y));
-  }
-};
-
-
-template<class Reference>
-struct rvalue_reference_to_lvalue_reference
-{
-  using type = Reference;
-};
-
-template<class T>
-struct rvalue_reference_to_lvalue_reference<T&&>
-{
-  using type = T&;
-};
-
-
-template<typename VisitorReference, typename Result, typename VariantReference>
-struct binary_visitor_binder
-{
-  VisitorReference visitor;
-  // since rvalue references can't be members of classes, we transform any
-  // VariantReference which is an rvalue reference to an lvalue reference
-  // when we use y in operator(), we cast it back to the original reference type
-  typename rvalue_reference_to_lvalue_reference<VariantReference>::type y;
-
-  binary_visitor_binder(VisitorReference visitor, VariantReference ref) : visitor(visitor), y(ref) {}
-
-  template<typename T>
-  Result operator()(T&& x)
-  {
-    auto unary_visitor = unary_visitor_binder<VisitorReference, Result, decltype(x)>(visitor, std::forward<T>(x));
-    return visit(unary_visitor, std::forward<VariantReference>(y));
-  }
-};
-
-
-} // end variant_detail
-} // end detail
-
-
 template<typename Visitor, typename Variant1, typename Variant2>
 typename std::result_of<
   Visitor&(detail::variant_detail::variant_alternative_reference_t<0,Variant1&&>,
@@ -930,9 +938,16 @@ typename std::result_of<
              detail::variant_detail::variant_alternative_reference_t<0,Variant2&&>)
   >::type;
 
-  auto visitor_wrapper = detail::variant_detail::binary_visitor_binder<Visitor&,result_type,decltype(var2)>(visitor, std::forward<Variant2>(var2));
+  using impl = detail::variant_detail::apply_binary_visitor<
+    Visitor&,
+    result_type,
+    detail::variant_detail::variant_pointer_t<Variant1>,
+    detail::variant_detail::variant_pointer_t<Variant2>,
+    typename std::decay<Variant1>::type,
+    typename std::decay<Variant2>::type
+  >;
 
-  return visit(visitor_wrapper, std::forward<Variant1>(var1));
+  return impl::do_it(visitor, &var1, var1.index(), &var2, var2.index());
 }
 
 
@@ -948,9 +963,16 @@ typename std::result_of<
                    detail::variant_detail::variant_alternative_reference_t<0,Variant2&&>)
   >::type;
 
-  auto visitor_wrapper = detail::variant_detail::binary_visitor_binder<const Visitor&,result_type,decltype(var2)>(visitor, std::forward<Variant2>(var2));
+  using impl = detail::variant_detail::apply_binary_visitor<
+    const Visitor&,
+    result_type,
+    detail::variant_detail::variant_pointer_t<Variant1>,
+    detail::variant_detail::variant_pointer_t<Variant2>,
+    typename std::decay<Variant1>::type,
+    typename std::decay<Variant2>::type
+  >;
 
-  return visit(visitor_wrapper, std::forward<Variant1>(var1));
+  return impl::do_it(visitor, &var1, var1.index(), &var2, var2.index());
 }
 
 